@@ -0,0 +1,57 @@
+//
+// Created by michele on 19.10.26.
+//
+
+#pragma once
+
+#include "camera.h"
+#include "filter.h"
+#include "scene.h"
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+/**
+ One image of a RenderBatch.
+ */
+struct RenderJob {
+    std::shared_ptr<Scene> scene;
+    std::function<void(Scene &)> setup;///< if not null, builds the scene as part of the batch, e.g. calling setup<T>
+    Camera camera;
+    int width;
+    int height;
+    std::string outputFile;
+};
+
+/**
+ Renders many small images for throughput rather than latency.
+
+ A single render of a small image cannot keep many cores busy: its parallel loop has few rows, and the scene setup
+ and the writing of the image run serially around it. The batch turns every stage of every job into OpenMP tasks on
+ one pool instead, so that the setup of a scene, the tiles of another and the writing of a third run at the same time.
+ */
+class RenderBatch
+{
+private:
+    static constexpr int TILE_SIZE = 16;///< side of a tile, in supersampled pixels
+
+    std::vector<RenderJob> jobs;
+    int SSAA = 1;
+    Filter filter = Filter::BOX;
+
+    void renderJob(const RenderJob &job) const;
+
+public:
+    RenderBatch &add(RenderJob job);
+    RenderBatch &setAntiAliasing(int SSAAFactor);
+    RenderBatch &setFilter(Filter filter);
+
+    [[nodiscard]] size_t size() const { return jobs.size(); }
+
+    /**
+     * Render and write all the jobs added so far, returning when every image has been written. The time is reported
+     * in the batch phase, so it does not count towards the rays per second of the statistics.
+     */
+    void render();
+};
@@ -0,0 +1,86 @@
+//
+// Created by michele on 19.10.26.
+//
+
+#pragma once
+
+#include "glm/glm.hpp"
+#include "objects/box.h"
+#include "ray.h"
+#include <array>
+#include <optional>
+#include <vector>
+
+/**
+ * Parameters for depth of field effect.
+ */
+struct DOFParams {
+    int samples;
+    float focalLength;
+    float aperture;
+};
+
+/**
+ Pinhole or thin-lens camera, placed anywhere in the scene.
+
+ In its own frame the camera sits at the origin, looking down +Z with +Y up, the image plane at SCENE_Z.
+ */
+class Camera
+{
+public:
+    static constexpr const float SCENE_Z = 1.0f;
+    static constexpr const DOFParams DEFAULT_LENS = {4, 8.0f, 0.2f};
+
+private:
+    glm::vec3 position = glm::vec3(0);
+    glm::vec3 right = glm::vec3(1, 0, 0);
+    glm::vec3 up = glm::vec3(0, 1, 0);
+    glm::vec3 forward = glm::vec3(0, 0, 1);
+    float fov;     ///< horizontal field of view in degrees
+    DOFParams lens;
+
+public:
+    explicit Camera(float fov = 90, DOFParams lens = DEFAULT_LENS) : fov(fov), lens(lens) {}
+
+    Camera &setPosition(const glm::vec3 &position);
+
+    /**
+     * Turn the camera towards target, keeping worldUp upwards in the image.
+     */
+    Camera &lookAt(const glm::vec3 &target, const glm::vec3 &worldUp = glm::vec3(0, 1, 0));
+
+    Camera &setFov(float fov);
+    Camera &setLens(DOFParams lens);
+
+    [[nodiscard]] glm::vec3 getPosition() const { return position; }
+    [[nodiscard]] glm::vec3 getForward() const { return forward; }
+    [[nodiscard]] glm::vec3 getUp() const { return up; }
+    [[nodiscard]] float getFov() const { return fov; }
+    [[nodiscard]] const DOFParams &getLens() const { return lens; }
+
+    /**
+     * @param i column of the pixel
+     * @param j row of the pixel, from the top
+     * @param width width of the image in pixels
+     * @param height height of the image in pixels
+     * @param lensSample point on the lens, in [-0.5, 0.5]^2
+     * @return the primary ray through the centre of the pixel, focused on the focal plane
+     */
+    [[nodiscard]] Ray generateRay(int i, int j, int width, int height, const glm::vec2 &lensSample) const;
+
+    /**
+     * @return the pixels {minX, minY, maxX, maxY} that the primary rays through the box may reach, accounting for the
+     * aperture of the lens, or nullopt if the box may cover the whole image
+     */
+    [[nodiscard]] std::optional<std::array<int, 4>> project(const Box &box, int width, int height) const;
+
+    /**
+     * Cameras evenly spaced on a horizontal circle, all looking at target, e.g. for a turntable.
+     * @param radius distance from the vertical axis through target
+     * @param height height of the cameras above target
+     */
+    static std::vector<Camera> orbit(const glm::vec3 &target, float radius, float height, int count, float fov = 90);
+
+    bool operator==(const Camera &other) const;
+    bool operator!=(const Camera &other) const { return !(*this == other); }
+};
@@ -0,0 +1,83 @@
+//
+// Created by michele on 19.10.26.
+//
+
+#pragma once
+
+#include "image.h"
+#include <array>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ Saves the progress of a long render to disk, so that it can resume after a crash or a pre-emption.
+
+ The image is rendered in tiles; the file holds which tiles are complete and, for those only, the accumulation buffer
+ of their pixels: the sum of the radiance of their samples and how many there are. With deterministic sampling (see
+ Sampler) the resumed render produces the same image as an uninterrupted one. The file is replaced atomically, so a
+ crash while saving leaves the previous checkpoint intact.
+
+ Layout, in native byte order:
+     char magic[4] = "RTCK", uint32 version, int32 width, int32 height, int32 tile size,
+     uint32 key length, char key[key length],
+     uint8 bitmap[(tiles + 7) / 8], bit t % 8 of byte t / 8 set if tile t is complete,
+     for each complete tile in order, for each of its pixels row by row: float sum[3], float samples
+ */
+class Checkpoint
+{
+public:
+    static constexpr int TILE_SIZE = 32;///< side of a tile, in supersampled pixels
+
+private:
+    static constexpr char MAGIC[4] = {'R', 'T', 'C', 'K'};
+    static constexpr uint32_t VERSION = 1;
+
+    const std::string path;
+    const std::string key;///< identifies the render the checkpoint belongs to
+    const int width;
+    const int height;
+    const int tilesX;
+    const int tilesY;
+    std::vector<uint8_t> done;
+    int completed = 0;
+
+public:
+    /**
+     * @param path file holding the checkpoint
+     * @param key identifies the render, e.g. its output file, so that the checkpoint of another one is not resumed
+     * @param width width of the supersampled image
+     * @param height height of the supersampled image
+     */
+    Checkpoint(std::string path, std::string key, int width, int height);
+
+    [[nodiscard]] int getTileCount() const { return tilesX * tilesY; }
+    [[nodiscard]] int getCompletedCount() const { return completed; }
+    [[nodiscard]] bool isDone(int tile) const { return done[tile]; }
+
+    /**
+     * @return the pixel bounds {minX, minY, maxX, maxY} (exclusive max) of a tile
+     */
+    [[nodiscard]] std::array<int, 4> getTile(int tile) const;
+
+    /**
+     * Record that all the samples of a tile are accumulated; they must not change afterwards.
+     */
+    void markDone(int tile);
+
+    /**
+     * Restore the complete tiles from the file into image, if the file exists and belongs to this render.
+     * @return false if there is nothing to resume, leaving image untouched
+     */
+    bool load(Image &image);
+
+    /**
+     * Write the complete tiles of image to the file.
+     */
+    bool save(const Image &image) const;
+
+    /**
+     * Delete the file, once the render it belongs to is written.
+     */
+    void remove() const;
+};
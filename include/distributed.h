@@ -0,0 +1,129 @@
+//
+// Created by michele on 19.10.26.
+//
+
+#pragma once
+
+#include "camera.h"
+#include "filter.h"
+#include "image.h"
+#include "raytracer.h"
+#include "scene.h"
+#include "socket.h"
+#include "writers/async.h"
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <vector>
+
+/*
+ Protocol between a RenderCoordinator and its RenderWorkers, one line per message, words separated by spaces:
+ - worker: HELLO
+ - coordinator: JOB <width> <height> <SSAA> <position xyz> <forward xyz> <up xyz> <fov> <samples> <focal length>
+   <aperture>, sizes in supersampled pixels
+ - worker: NEXT, asking for work
+ - coordinator: TILE <frame> <x> <y> <width> <height>, or DONE when the job is finished
+ - worker: PIXELS <frame> <x> <y> <width> <height>, followed by width * height * 3 native floats of linear radiance,
+   then NEXT again
+ */
+
+/**
+ Splits the frames of a render into tiles handed out to RenderWorker processes, possibly on other machines, and
+ assembles their pixels into the output images.
+
+ Workers pull one tile at a time, so faster workers naturally take more. Once no tile is left, an idle worker steals
+ a copy of a tile still being rendered by another one, so that a straggler or a worker that died does not hold up
+ the end of the job; the first copy returned wins. Every frame is written as soon as its last tile arrives.
+ */
+class RenderCoordinator
+{
+private:
+    static constexpr int MAX_COPIES = 2;///< workers rendering the same tile at once
+
+    struct Tile {
+        int frame;
+        int x;
+        int y;
+        int width;
+        int height;
+        int copies = 0;  ///< workers currently rendering the tile
+        bool done = false;
+    };
+
+    struct Frame {
+        std::optional<Image> image;
+        int remaining = 0;///< tiles not received yet
+    };
+
+    const Raytracer &settings;
+    int tileSize = 64;
+    AsyncImageWriter writer;
+
+    std::vector<Tile> tiles;
+    std::deque<size_t> pending;///< tiles never handed out, in frame order
+    std::vector<Frame> frames;
+    int firstFrame = 0;
+    std::string framePattern;
+    size_t remainingTiles = 0;
+    std::mutex mutex;
+    std::condition_variable changed;///< signalled when a tile is done or a worker leaves
+
+    Socket listener;
+    std::vector<int> workerDescriptors;///< sockets of the connected workers, shut down once every tile is done
+
+    void serveWorker(Socket &worker);
+
+    /**
+     * Wait for a tile to hand out. @return its index, or nullopt when every tile is done
+     */
+    std::optional<size_t> takeTile();
+
+    /**
+     * Resolve and queue for writing a frame whose tiles have all arrived.
+     */
+    void writeFrame(int frame, const Image &image);
+
+public:
+    /**
+     * @param settings size, anti-aliasing, filter and camera of the render
+     */
+    explicit RenderCoordinator(const Raytracer &settings) : settings(settings) {}
+
+    /**
+     * Side of the tiles handed out, in supersampled pixels.
+     */
+    RenderCoordinator &setTileSize(int size);
+
+    /**
+     * Listen for workers on address ([host]:port or a Unix socket path) and render the frames from firstFrame to
+     * lastFrame, returning when all of them have been written.
+     * @param framePattern printf pattern receiving the frame number to name each output file
+     * @return false if the address cannot be listened on
+     */
+    bool render(const std::string &address, int firstFrame, int lastFrame, const std::string &framePattern);
+};
+
+/**
+ Renders the tiles handed out by a RenderCoordinator on a scene built by the worker process.
+ */
+class RenderWorker
+{
+private:
+    Scene &scene;
+    const FrameUpdate update;
+
+public:
+    /**
+     * @param update moves the objects of the scene to a frame, as in Raytracer::renderAnimation; may be null for
+     * still images
+     */
+    explicit RenderWorker(Scene &scene, FrameUpdate update = nullptr) : scene(scene), update(std::move(update)) {}
+
+    /**
+     * Connect to the coordinator at address and render tiles until the job is done.
+     * @return false if the connection failed or was lost before the end of the job
+     */
+    bool run(const std::string &address);
+};
@@ -0,0 +1,28 @@
+//
+// Created by michele on 19.10.26.
+//
+
+#pragma once
+
+/**
+ Reconstruction filters used to resample images, e.g. to resolve supersampled renders or produce thumbnails.
+ */
+enum class Filter {
+    BOX,           ///< average of the samples covered by the pixel, the cheapest and blurriest at edges
+    TENT,          ///< linear falloff over a radius of one pixel
+    MITCHELL,      ///< Mitchell-Netravali cubic with B = C = 1/3, sharp with slight negative lobes
+    BLACKMAN_HARRIS///< windowed cosine sum, smooth with almost no aliasing
+};
+
+/**
+ * @return the radius of the filter, in destination pixels
+ */
+float getFilterRadius(Filter filter);
+
+/**
+ * Evaluate the (unnormalised) filter.
+ * @param x distance from the centre of the destination pixel, in destination pixels
+ */
+float evaluateFilter(Filter filter, float x);
+
+const char *getFilterName(Filter filter);
@@ -0,0 +1,59 @@
+//
+// Created by michele on 19.10.26.
+//
+
+#pragma once
+
+#include "glm/glm.hpp"
+#include "stats.h"
+#include <array>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * Per-pixel record of the work done to render an image, written as false-colour images for diagnostics.
+ */
+class CostHeatmap
+{
+public:
+    enum Channel {
+        NODE_VISITS,
+        PRIMITIVE_TESTS,
+        SHADOW_RAYS,
+        RAY_DEPTH,
+        NUM_CHANNELS
+    };
+
+private:
+    const int width;
+    const int height;
+    std::array<std::vector<uint32_t>, NUM_CHANNELS> channels;
+
+    static const char *getSuffix(Channel channel);
+
+    /**
+     * Map a value in [0, 1] to a black-blue-red-yellow-white colour ramp.
+     */
+    static glm::vec3 falseColor(float t);
+
+public:
+    CostHeatmap(int width, int height);
+
+    /**
+     * Store the cost of a pixel as the difference between the counters of the rendering thread after and before it.
+     * @param x x coordinate of the pixel - index of the column counting from left to right
+     * @param y y coordinate of the pixel - index of the row counting from top to bottom
+     * @param before counters of the thread before rendering the pixel
+     * @param after counters of the thread after rendering the pixel
+     */
+    void record(int x, int y, const Stats::ThreadSlot &before, const Stats::ThreadSlot &after);
+
+    /**
+     * Write one false-colour image per channel next to the given image, e.g. result.ppm -> result.nodes.ppm.
+     * Costs are summed (depth is maxed) over blocks of factor x factor pixels, to match a supersampled render.
+     * @param imagePath path of the beauty image
+     * @param factor supersampling factor of the recorded costs
+     */
+    void write(const std::string &imagePath, int factor = 1) const;
+};
@@ -1,4 +1,3 @@
-//
 /**
 @file Image.h
 */
@@ -12,19 +11,31 @@
 
 #pragma once
 
+#include "filter.h"
 #include "glm/glm.hpp"
 #include <fstream>
 #include <vector>
 
 /**
- Class allowing for creating an image and writing it to a file
+ Operator mapping a linear radiance to a displayable color in range from 0 to 1
+ */
+using ToneMapping = glm::vec3 (*)(glm::vec3);
+
+/**
+ Class allowing for creating an image and writing it to a file.
+
+ The pixels are stored in a single contiguous row-major buffer of linear (HDR) radiance, accumulated together with
+ the weight of the samples that contributed to them. Tone mapping and quantisation happen only when writing.
  */
 class Image
 {
 private:
-    const int width;                         ///< width of the image
-    const int height;                        ///< height of the image
-    std::vector<std::vector<glm::vec3>> data;///< a pointer to the data representing the images
+    const int width;           ///< width of the image
+    const int height;          ///< height of the image
+    std::vector<glm::vec3> data;///< row-major sum of the weighted radiance samples of each pixel
+    std::vector<float> weights; ///< row-major sum of the weights of the samples of each pixel
+
+    [[nodiscard]] size_t index(int x, int y) const { return (size_t) y * width + x; }
 
 public:
     /**
@@ -33,11 +44,15 @@ public:
 	 */
     Image(int width, int height);
 
+    [[nodiscard]] int getWidth() const { return width; }
+    [[nodiscard]] int getHeight() const { return height; }
+
     /**
-	 Writes and image to a file in ppm format
+	 Writes and image to a file, in the format given by its extension (binary .ppm or .pfm)
 	 @param path the path where to the target image
+	 @param toneMapping operator applied to the radiance of each pixel before quantisation, clamping if null
 	 */
-    void writeImage(const std::string &path) const;
+    void writeImage(const std::string &path, ToneMapping toneMapping = nullptr) const;
 
     /**
 	 Set a value for one pixel
@@ -53,19 +68,70 @@ public:
 	 Set a value for one pixel
 	 @param x x coordinate of the pixel - index of the column counting from left to right
 	 @param y y coordinate of the pixel - index of the row counting from top to bottom
-	 @param r red chanel value in range from 0 to 1
-	 @param g green chanel value in range from 0 to 1
-	 @param b blue chanel value in range from 0 to 1
+	 @param r red chanel radiance
+	 @param g green chanel radiance
+	 @param b blue chanel radiance
 	 */
     void setPixel(int x, int y, float r, float g, float b);
 
     /**
-	 Set a value for one pixel
+	 Set a value for one pixel, replacing the samples accumulated so far
 	 @param x x coordinate of the pixel - index of the column counting from left to right
 	 @param y y coordinate of the pixel - index of the row counting from top to bottom
-	 @param color color of the pixel expressed as vec3 of RGB values in range from 0 to 1
+	 @param color linear radiance of the pixel expressed as vec3 of RGB values
 	 */
     void setPixel(int x, int y, glm::vec3 color);
 
-    [[nodiscard]] Image downsample(int factor) const;
+    /**
+	 Accumulate a sample into one pixel
+	 @param x x coordinate of the pixel - index of the column counting from left to right
+	 @param y y coordinate of the pixel - index of the row counting from top to bottom
+	 @param color linear radiance of the sample
+	 @param weight weight of the sample
+	 */
+    void addSample(int x, int y, glm::vec3 color, float weight = 1.0f);
+
+    /**
+	 @return the weighted average of the samples of the pixel, black if it has none
+	 */
+    [[nodiscard]] glm::vec3 getPixel(int x, int y) const;
+
+    /**
+	 @return the sum of the weights of the samples of the pixel
+	 */
+    [[nodiscard]] float getWeight(int x, int y) const;
+
+    /**
+	 @return the weighted sum of the samples of the pixel, as accumulated so far
+	 */
+    [[nodiscard]] glm::vec3 getSum(int x, int y) const;
+
+    /**
+	 Replace the samples accumulated into one pixel, e.g. when restoring a checkpoint
+	 @param sum weighted sum of the samples
+	 @param weight sum of the weights of the samples
+	 */
+    void setAccumulated(int x, int y, glm::vec3 sum, float weight);
+
+    /**
+	 Resolve the average radiance of consecutive rows
+	 @param y index of the first row
+	 @param count number of rows
+	 @param out destination of count * width row-major pixels
+	 */
+    void resolveRows(int y, int count, glm::vec3 *out) const;
+
+    /**
+	 Resample the image to an arbitrary size, e.g. to produce a thumbnail. The filter is applied separably, first
+	 along the rows and then along the columns, each pass parallel over the rows of its output.
+	 @param newWidth width of the resampled image
+	 @param newHeight height of the resampled image
+	 @param filter reconstruction filter, stretched to cover a destination pixel when shrinking
+	 */
+    [[nodiscard]] Image resize(int newWidth, int newHeight, Filter filter = Filter::BOX) const;
+
+    /**
+	 Resolve a supersampled image, reducing each side by factor
+	 */
+    [[nodiscard]] Image downsample(int factor, Filter filter = Filter::BOX) const;
 };
@@ -11,11 +11,68 @@
 const constexpr int MAX_RAY_DEPTH = 10;
 
 /**
- Functions that computes a color along the ray
+ Secondary rays carrying less than this fraction of the light of the pixel are traced with probability proportional to
+ their weight (Russian roulette)
+ */
+const constexpr float ROULETTE_WEIGHT = 0.01f;
+
+/**
+ Maximum number of secondary rays of a pixel waiting to be traced; beyond it the lightest are dropped
+ */
+const constexpr size_t RAY_STACK_SIZE = 16;
+
+/**
+ Number of samples of a light first tested for occlusion; the others are only tested when these disagree, i.e. in the
+ penumbra
+ */
+const constexpr int SHADOW_PROBES = 4;
+
+/**
+ Scenes with more lights than this do not shade each point with all of them, but with LIGHT_TREE_PICKS lights picked
+ by importance from the light tree of the scene
+ */
+const constexpr size_t LIGHT_TREE_THRESHOLD = 8;
+const constexpr int LIGHT_TREE_PICKS = 2;
+
+/**
+ Phong reflectance of a surface: the light of unit color coming from light_direction reflected towards the viewer
+ @param albedo diffuse coefficient of the material, multiplied by its texture
+ @param specular specular coefficient of the material
+ @param shininess Phong exponent of the material
+ @return black if the light is below the surface
+ */
+glm::vec3 phong_brdf(const glm::vec3 &normal, const glm::vec3 &light_direction, const glm::vec3 &view_direction,
+                     const glm::vec3 &albedo, const glm::vec3 &specular, float shininess);
+
+/**
+ Fractions of the light of a hit carried by its reflected and refracted rays, after the Fresnel equations and total
+ internal reflection
+ @param view_direction unit direction towards the origin of the ray
+ @param inside_object whether the ray hit the surface from inside the object, normal being flipped towards it
+ @return the reflected fraction in x and the refracted one in y
+ */
+glm::vec2 specular_factors(const glm::vec3 &normal, const glm::vec3 &view_direction, const Material &material,
+                           bool inside_object);
+
+/**
+ @return whether something, other than the light itself, lies between point and a point of the light
+ */
+bool is_occluded(const Scene &scene, const glm::vec3 &point, const glm::vec3 &sample, const Light &light);
+
+/**
+ Functions that computes a color along the ray. The tree of reflected and refracted rays is evaluated iteratively,
+ keeping the pending rays on a fixed-size stack and tracing the ones carrying the most light first.
  @param ray Ray that should be traced through the scene
+ @param primary_hit if not null, receives the closest hit of the ray itself, so callers need not intersect it again
  @return Color at the intersection point
  */
-glm::vec3 trace_ray(const Scene &scene, const Ray &ray, int depth = 0, float refl_cumulative = 1.0f, float refr_cumulative = 1.0f);
+glm::vec3 trace_ray(const Scene &scene, const Ray &ray, std::optional<Hit> *primary_hit = nullptr);
+
+/**
+ Light reflected and refracted at a hit, i.e. the color of the hit without its local (ambient and direct) lighting
+ @param ray primary ray that produced the hit
+ */
+glm::vec3 trace_secondary(const Scene &scene, const Ray &ray, const Hit &hit, const Material &material);
 
 /**
  Function performing tonemapping of the intensities computed using the raytracer
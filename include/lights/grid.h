@@ -0,0 +1,54 @@
+//
+// Created by michele on 19.10.26.
+//
+
+#pragma once
+
+#include "light.h"
+#include "objects/box.h"
+#include <array>
+#include <memory>
+#include <vector>
+
+/**
+ Uniform grid over the space lit by the lights of a scene, listing in each cell the lights that can reach it.
+
+ Each light reaches as far as its intensity, attenuated with the square of the distance from its bounds, stays above a
+ threshold: beyond this influence radius its contribution is negligible and it is skipped before any shading or shadow
+ ray. The grid spans the union of the regions of influence, so points outside it are reached by no light.
+ */
+class LightGrid
+{
+private:
+    static constexpr int CELLS_PER_LIGHT = 8;///< target number of cells of the grid for each light
+    static constexpr int MAX_RESOLUTION = 64;///< maximum number of cells along an axis
+
+    struct Influence {
+        Box bounds;
+        float radius;
+    };
+
+    std::vector<Influence> influences;///< region reached by each light of the scene
+    Box bounds;
+    std::array<int, 3> resolution = {0, 0, 0};
+    glm::vec3 cellSize = glm::vec3(1);
+    std::vector<std::vector<int>> cells;
+
+    [[nodiscard]] static float distance(const Box &a, const Box &b);
+
+public:
+    /**
+     * @param threshold intensity below which a light is negligible
+     */
+    LightGrid(const std::vector<std::shared_ptr<Light>> &lights, float threshold);
+
+    /**
+     * @return the indices of the lights that may reach the cell of the point
+     */
+    [[nodiscard]] const std::vector<int> &query(const glm::vec3 &point) const;
+
+    /**
+     * @return whether the point is within the influence radius of the light
+     */
+    [[nodiscard]] bool reaches(int light, const glm::vec3 &point) const;
+};
@@ -5,9 +5,39 @@
 #pragma once
 
 #include "glm/glm.hpp"
+#include "objects/box.h"
 #include "objects/object.h"
+#include "sampler.h"
+#include <cmath>
 #include <memory>
 #include <vector>
+
+/**
+ Point of a light, with the orientation of the surface emitting from it.
+ */
+struct LightPoint {
+    glm::vec3 position;
+    glm::vec3 normal;///< normal of the emitting surface, zero for lights shining equally in all directions
+
+    /**
+     * @return the fraction of the intensity of the light emitted from the point towards target
+     */
+    [[nodiscard]] float emission(const glm::vec3 &target) const
+    {
+        if (normal == glm::vec3(0))
+            return 1.0f;
+        return std::abs(glm::dot(normal, glm::normalize(target - position)));
+    }
+};
+
+/**
+ Point of a light illuminating a shaded point.
+ */
+struct LightSample {
+    glm::vec3 position;
+    float weight;///< fraction of the color of the light carried by the sample towards the shaded point
+};
+
 /**
  Light class
  */
@@ -27,10 +57,28 @@ public:
      */
     [[nodiscard]] virtual const std::vector<glm::vec3> &getSamples() const;
 
+    /**
+     * Draw the points of the light illuminating a point of the scene. By default the fixed samples, equally weighted.
+     * @param sampler random numbers, seeded by the caller so that the render is deterministic
+     * @param out receives the samples, in an order such that the first ones alone already cover the whole light
+     */
+    virtual void sample(const glm::vec3 &point, Sampler &sampler, std::vector<LightSample> &out) const;
+
+    /**
+     * Map a point of the unit square to a point of the light, uniformly over its extent. By default one of the fixed
+     * samples.
+     */
+    [[nodiscard]] virtual LightPoint samplePoint(const glm::vec2 &u) const;
+
     /**
      * @return the color of the light
      */
     [[nodiscard]] glm::vec3 getColor() const;
 
+    /**
+     * @return the box enclosing every point the light is emitted from
+     */
+    [[nodiscard]] virtual Box getBounds() const;
+
     [[nodiscard]] virtual std::shared_ptr<Object> getLightObject() const;
 };
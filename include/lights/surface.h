@@ -7,10 +7,19 @@
 #include "light.h"
 #include "objects/object.h"
 
+/**
+ Light emitted by the surface of an object, as a Lambertian emitter whose color is the intensity emitted along its
+ normal.
+
+ Each shaded point draws its own stratified points on the surface, so that neighbouring points do not share the same
+ pattern. Objects that cannot be sampled fall back to fixed random points, ordered so that any prefix of them covers the
+ surface evenly.
+ */
 class SurfaceLight: public Light
 {
 private:
-    constexpr static int SAMPLES = 50;
+    constexpr static int SAMPLES = 50;///< fixed samples, bounding the extent of the light
+    constexpr static int GRID = 4;    ///< side of the grid of strata drawn per shaded point
 
     const std::shared_ptr<Object> object;
 
@@ -18,5 +27,9 @@ public:
     explicit SurfaceLight(const std::shared_ptr<Object> &object);
     SurfaceLight(glm::vec3 color, const std::shared_ptr<Object> &object);
 
+    void sample(const glm::vec3 &point, Sampler &sampler, std::vector<LightSample> &out) const override;
+    [[nodiscard]] LightPoint samplePoint(const glm::vec2 &u) const override;
+
+    [[nodiscard]] Box getBounds() const override;
     [[nodiscard]] std::shared_ptr<Object> getLightObject() const override;
 };
\ No newline at end of file
@@ -0,0 +1,57 @@
+//
+// Created by michele on 19.10.26.
+//
+
+#pragma once
+
+#include "light.h"
+#include "objects/box.h"
+#include "sampler.h"
+#include <memory>
+#include <optional>
+#include <utility>
+#include <vector>
+
+/**
+ Bounding volume hierarchy over the lights of a scene, to pick the lights illuminating a point by importance.
+
+ Each node bounds the extent and the total power of the lights below it. A light is picked by walking down from the
+ root, choosing each child with probability proportional to an estimate of its contribution at the point: its power
+ over the squared distance, scaled by how much it rises above the tangent plane of the surface. The probability of the
+ whole path is returned, so that dividing the contribution of the light by it keeps the estimate unbiased. Only
+ lights lying entirely below the tangent plane, which cannot contribute, are never picked.
+
+ The emitters of this renderer shine in all directions or on both sides, so nodes carry no bound on the orientation of
+ the emission.
+ */
+class LightTree
+{
+private:
+    struct Node {
+        Box bounds;
+        float power;///< sum of the power of the lights below the node
+        int child;  ///< index of the first child, the second following it, or -1 for leaves
+        int light;  ///< index of the light of a leaf
+    };
+
+    std::vector<Node> nodes;
+
+    /**
+     * Build into nodes[index] the subtree over the entries in [begin, end), each the bounds and the index of a light.
+     */
+    void build(std::vector<std::pair<Box, int>> &entries, size_t begin, size_t end,
+               const std::vector<std::shared_ptr<Light>> &lights, int index);
+
+    [[nodiscard]] float importance(const Node &node, const glm::vec3 &point, const glm::vec3 &normal) const;
+
+public:
+    explicit LightTree(const std::vector<std::shared_ptr<Light>> &lights);
+
+    /**
+     * Pick one light for a point on a surface.
+     * @return the index of the light in the scene and the probability of picking it, nullopt if no light can reach
+     * the point
+     */
+    [[nodiscard]] std::optional<std::pair<int, float>> pick(const glm::vec3 &point, const glm::vec3 &normal,
+                                                            Sampler &sampler) const;
+};
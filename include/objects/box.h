@@ -45,6 +45,21 @@ public:
         return Hit{glm::vec3(0), glm::vec3(0), tNear, nullptr, glm::vec2(0)};
     }
 
+    /**
+     * @return whether the segment between the two points crosses the box
+     */
+    [[nodiscard]] bool intersectsSegment(const glm::vec3 &from, const glm::vec3 &to) const
+    {
+        const glm::vec3 invDir = 1.0f / (to - from);
+        const glm::vec3 t0 = (min - from) * invDir;
+        const glm::vec3 t1 = (max - from) * invDir;
+        const glm::vec3 tmin = glm::min(t0, t1);
+        const glm::vec3 tmax = glm::max(t0, t1);
+        const float tNear = glm::max(glm::max(glm::max(tmin.x, tmin.y), tmin.z), 0.0f);
+        const float tFar = glm::min(glm::min(glm::min(tmax.x, tmax.y), tmax.z), 1.0f);
+        return tNear <= tFar;
+    }
+
     void merge(const Box &box)
     {
         min.x = glm::min(min.x, box.min.x);
@@ -58,7 +73,7 @@ public:
 
     Box operator+(const Box &box) const
     {
-        Box newBox;
+        Box newBox = *this;
         newBox.merge(box);
         return newBox;
     }
@@ -7,10 +7,12 @@
 #include "../glm/ext/matrix_transform.hpp"
 #include "object.h"
 #include "sphere.h"
+#include "stats.h"
 #include "tracers/kdtree.h"
 #include "tracers/naive.h"
 #include "triangle.h"
 #include <array>
+#include <iostream>
 #include <memory>
 #include <string>
 #include <vector>
@@ -43,11 +45,23 @@ public:
         for (auto &triangle : this->_triangles) {
             triangle->transform(transformation);
         }
+        invalidate();
     }
 
     void initializeTracer()
     {
-        this->_tracer = std::make_unique<TracerClass>(this->_triangles);
+        {
+            ScopedTimer timer(Phase::ACCELERATION_BUILD);
+            this->_tracer = std::make_unique<TracerClass>(this->_triangles);
+        }
+        getTracerStats().print(std::cout);
+    }
+
+    [[nodiscard]] TracerStats getTracerStats() const
+    {
+        TracerStats stats = this->_tracer->getStats();
+        stats.name += " (" + this->_name + ")";
+        return stats;
     }
 
 protected:
@@ -4,6 +4,7 @@
 
 #pragma once
 
+#include <cstdint>
 #include <optional>
 #include <variant>
 
@@ -12,6 +13,14 @@
 #include "../ray.h"
 #include "box.h"
 
+/**
+ Point on the surface of an object, in global coordinates.
+ */
+struct SurfacePoint {
+    glm::vec3 point;
+    glm::vec3 normal;///< unit normal at the point
+};
+
 /**
  General class for the object
  */
@@ -20,6 +29,7 @@ class Object
 protected:
     std::variant<glm::vec3, Material> surface;///< Surface of the object: either a color (i.e. vec3) or a material
     std::optional<Box> boundingBox;                 ///< Bounding box of the object
+    uint64_t version = 0;                           ///< Incremented whenever the object moves or its surface changes
 
     glm::mat4 transformationMatrix = glm::mat4(
         1.0f);///< Matrix representing the transformation from the local to the global coordinate system
@@ -34,6 +44,15 @@ protected:
 
     [[nodiscard]] virtual Box computeBoundingBox() = 0;
 
+    /**
+     * Record that the geometry or the surface of the object changed, dropping the cached bounding box.
+     */
+    void invalidate()
+    {
+        boundingBox.reset();
+        version++;
+    }
+
 public:
     virtual ~Object() = default;
 
@@ -52,6 +71,13 @@ public:
     /** A function computing an intersection, which returns the structure Hit */
     virtual std::optional<Hit> intersect(const Ray &ray) = 0;
     [[nodiscard]] virtual std::vector<glm::vec3> getSamples(int n) const;
+
+    /**
+     * Map a point of the unit square to the surface, preserving area: uniformly distributed inputs give uniformly
+     * distributed points. Used to sample objects emitting light.
+     * @return nullopt if the object cannot be sampled this way
+     */
+    [[nodiscard]] virtual std::optional<SurfacePoint> sampleSurface(const glm::vec2 &u) const;
     Box &getBoundingBox();
 
     template<typename T>
@@ -79,14 +105,34 @@ public:
     void setSurface(const S &s)
     {
         surface = s;
+        invalidate();
+    }
+
+    /**
+     * @return a counter changing whenever the object moves or its surface changes, used to detect what changed
+     * between two frames of an animation
+     */
+    [[nodiscard]] uint64_t getVersion() const
+    {
+        return version;
     }
 
 
     virtual void transform(const glm::mat4 &transformation)
     {
-        transformationMatrix *= transformation;
+        setTransformation(transformationMatrix * transformation);
+    }
+
+    /**
+     * Replace the transformation from the local to the global coordinate system, e.g. to move an object between the
+     * frames of an animation. The tracer holding the object must be rebuilt afterwards (see Scene::rebuild).
+     */
+    void setTransformation(const glm::mat4 &transformation)
+    {
+        transformationMatrix = transformation;
         inverseTransformationMatrix = glm::inverse(transformationMatrix);
         normalMatrix = glm::transpose(inverseTransformationMatrix);
+        invalidate();
     }
     glm::vec3 coordsToLocal(const glm::vec3 &point, float w) const;
 };
\ No newline at end of file
@@ -71,6 +71,15 @@ public:
         return samples;
     }
 
+    [[nodiscard]] std::optional<SurfacePoint> sampleSurface(const glm::vec2 &u) const override
+    {
+        const float z = 1 - 2 * u.x;
+        const float r = std::sqrt(std::max(0.0f, 1 - z * z));
+        const float phi = 2 * (float) M_PI * u.y;
+        const glm::vec3 point(r * std::cos(phi), r * std::sin(phi), z);
+        return SurfacePoint{coordsToGlobal(point, 1), glm::normalize(glm::vec3(normalMatrix * glm::vec4(point, 0)))};
+    }
+
 protected:
     Box computeBoundingBox() override
     {
@@ -19,6 +19,7 @@ public:
 
     [[nodiscard]] std::optional<Hit> intersect(const Ray &ray) override;
     [[nodiscard]] std::vector<glm::vec3> getSamples(int n) const override;
+    [[nodiscard]] std::optional<SurfacePoint> sampleSurface(const glm::vec2 &u) const override;
 
 protected:
     Box computeBoundingBox() override;
@@ -95,6 +95,13 @@ public:
         }
         return samples;
     }
+
+    [[nodiscard]] std::optional<SurfacePoint> sampleSurface(const glm::vec2 &u) const override
+    {
+        const float r1 = std::sqrt(u.x);
+        const glm::vec3 point = (1 - r1) * points[0] + (r1 * (1 - u.y)) * points[1] + (r1 * u.y) * points[2];
+        return SurfacePoint{coordsToGlobal(point, 1), glm::normalize(coordsToGlobal(normal, 0))};
+    }
 protected:
     Box computeBoundingBox() override
     {
@@ -0,0 +1,35 @@
+//
+// Created by michele on 19.10.26.
+//
+
+#pragma once
+
+#include "glm/glm.hpp"
+#include "ray.h"
+#include "sampler.h"
+#include "scene.h"
+
+/**
+ Bounces after which a path is continued with probability given by its throughput (Russian roulette)
+ */
+const constexpr int PATH_ROULETTE_BOUNCES = 3;
+
+/**
+ Radiance along one path starting with the ray, estimated by unidirectional path tracing with next-event estimation.
+
+ At each hit a single point of a single light is sampled, picked uniformly or, in scenes with many lights, from the
+ light tree, and shaded with the Phong model of trace_ray after one shadow ray, so that the direct light matches the
+ Whitted render. The path then goes on along one of the continuations of the Whitted tracer, picked in proportion to
+ what it carries: the mirror reflection, the refraction, or a diffuse bounce in a cosine-distributed direction, which
+ adds the indirect light trace_ray lacks. Diffuse bounces follow the albedo / pi BRDF, as if every light were pi times
+ brighter than its color, the convention under which the Phong model of trace_ray needs no 1 / pi. Since the indirect
+ light is estimated, the ambient term of the materials is not used. Objects without a material are emitters, ending the
+ path with their color; after a diffuse bounce they add nothing, since the light sampled at the previous hit already
+ accounts for them. Paths end after MAX_RAY_DEPTH bounces, or earlier by Russian roulette. Diffuse bounces are not
+ counted in the ray statistics.
+
+ The loop keeps no stack and each bounce traces at most two rays, so the cost of a sample is bounded and roughly the
+ same everywhere; quality grows by averaging more samples.
+ @param sampler source of every random decision of the path
+ */
+glm::vec3 trace_path(const Scene &scene, const Ray &ray, Sampler &sampler);
@@ -5,51 +5,223 @@
 #ifndef RAYTRACER_H
 #define RAYTRACER_H
 
+#include "camera.h"
+#include "checkpoint.h"
+#include "heatmap.h"
 #include "image.h"
+#include "reservoir.h"
 #include "scene.h"
+#include "temporal.h"
+#include "writers/async.h"
+#include <array>
+#include <functional>
 #include <memory>
+#include <optional>
 #include <string>
 #include <utility>
 
 
 /**
- * Parameters for depth of field effect.
+ * Callback moving the objects of the scene to their position at the given frame of an animation.
  */
-struct DOFParams {
-    int samples;
-    float focalLength;
-    float aperture;
-};
+using FrameUpdate = std::function<void(Scene &scene, int frame)>;
 
 
 class Raytracer
 {
 private:
-    static constexpr const char *DEFAULT_OUTPUT_FILE = "output.ppm";
-    static constexpr const float SCENE_Z = 1.0f;
-    static constexpr const DOFParams DOF_PARAMS = {4, 8.0f, 0.2f};
+    static constexpr const char *DEFAULT_OUTPUT_FILE = "result.png";
+    static constexpr int TILE_SIZE = 16;///< side of the tiles scheduled when rendering several views
 
     const int _width;
     const int _height;
-    const int _fov;
+    Camera _camera;
 
     std::string _outputFile;
+    std::string _statsFile;
+    std::string _traceFile;
     int _SSAA = 1;
+    bool _costHeatmaps = false;
+    int _stripHeight = 0;
+    Filter _filter = Filter::BOX;
+    std::string _thumbnailFile;
+    int _thumbnailSize = 0;
+    std::string _checkpointFile;
+    int _checkpointInterval = 0;
+    int _pathPasses = 0;
+
+    std::shared_ptr<AsyncImageWriter> _writer;///< writes the rendered images in the background
+    std::shared_ptr<TemporalCache> _temporal; ///< previous frame, if only the tiles that changed are traced again
+    std::shared_ptr<ReservoirLighting> _reservoirs;///< reservoirs of the previous frame, if resampling direct light
+
+    /**
+     * Render consecutive supersampled rows of the image.
+     * @param image destination, holding image.getHeight() rows of the full supersampled image starting from firstRow
+     * @param firstRow index of the first row to render
+     * @param heatmap if not null, records the cost of each pixel, indexed in the full supersampled image
+     */
+    void renderRows(const Scene &scene, Image &image, int firstRow, CostHeatmap *heatmap) const;
+
+    /**
+     * Trace again the tiles of the previous frame affected by the objects that changed.
+     * @return the supersampled image of the frame, owned by the temporal cache
+     */
+    const Image &renderTemporal(const Scene &scene, CostHeatmap *heatmap);
+
+    /**
+     * Render the tiles not restored from the checkpoint file, saving the progress periodically.
+     * @param image supersampled image, accumulating the samples of each pixel
+     */
+    void renderCheckpointed(const Scene &scene, Image &image, CostHeatmap *heatmap) const;
+
+    /**
+     * Render with the path tracer, accumulating one path per lens sample of every pixel at each pass.
+     */
+    void renderPaths(const Scene &scene, Image &image) const;
+
+    /**
+     * Render horizontal strips one at a time, appending each to the output file before starting the next one.
+     */
+    void renderStrips(const Scene &scene);
 
 public:
+    /**
+     * Trace the primary rays of a pixel.
+     * @param width width of the (supersampled) image
+     * @param height height of the (supersampled) image
+     * @param footprint if not null, adds what the pixel depends on for the temporal reuse, e.g. to the footprint of its
+     * tile
+     * @return the average radiance of the rays
+     */
+    static glm::vec3 renderPixel(const Scene &scene, const Camera &camera, int i, int j, int width, int height,
+                                 PixelFootprint *footprint);
+
+    /**
+     * Primary ray of one of the samples of a pixel. The point on the lens depends only on the pixel and the index of
+     * the sample, so that every run traces the same rays.
+     * @param sample index of the sample, below the number of samples of the lens
+     */
+    static Ray primaryRay(const Camera &camera, int i, int j, int width, int height, int sample);
+
     Raytracer(int width, int height, int fov);
     Raytracer(int width, int height, int fov, std::string outputFile);
 
     Raytracer &setAntiAliasing(int SSAAFactor);
+
+    /**
+     * Camera used by render; by default at the origin looking down +Z with the field of view of the constructor.
+     */
+    Raytracer &setCamera(const Camera &camera);
     Raytracer &setOutputFile(std::string outputFile);
 
+    /**
+     * Write the performance statistics as JSON to the given file when finish is called. Like the printed report, they
+     * are cumulative: they add up every scene setup and every render of the process so far, e.g. all the frames of
+     * renderAnimation or all the views of renderViews.
+     */
+    Raytracer &setStatsFile(std::string statsFile);
+
+    /**
+     * Record per pixel the KD-tree nodes visited, primitives tested, shadow rays cast and ray depth reached, and
+     * write them as false-colour images next to the rendered image.
+     */
+    Raytracer &setCostHeatmaps(bool enabled);
+
+    /**
+     * Write the timeline of each render to the given file in Chrome trace format. Requires a build with TRACE=1.
+     */
+    Raytracer &setTraceFile(std::string traceFile);
+
+    /**
+     * Render and write the image in strips of the given number of rows, so that the memory needed is proportional
+     * to the strip height and not to the image size. 0 renders the whole image at once. The rows of the neighbouring
+     * strips within the radius of the filter are rendered with each strip, so that the strips join without seams.
+     */
+    Raytracer &setStripHeight(int rows);
+
+    /**
+     * Keep each rendered frame and, in the next render, trace again only the tiles that the objects that changed in the
+     * meantime may affect, copying the others. Meant for animations of mostly static scenes with a fixed camera.
+     */
+    Raytracer &setTemporalReuse(bool enabled);
+
+    /**
+     * Light the primary hits by reservoir resampling, reusing light samples across neighbouring pixels and across
+     * frames: far less noise with many or large lights for the same shadow rays, at the cost of some bias near shadow
+     * boundaries. Reflections and refractions keep the regular shading.
+     */
+    Raytracer &setReservoirLighting(bool enabled);
+
+    /**
+     * Render with the path tracer instead of the Whitted tracer, adding indirect light: the image is refined by the
+     * given number of passes over all the pixels, each tracing one path per lens sample. 0 selects the Whitted
+     * tracer again.
+     */
+    Raytracer &setPathTracing(int passes);
+
+    /**
+     * Reconstruction filter used to resolve the supersampled image and to produce the thumbnail.
+     */
+    Raytracer &setFilter(Filter filter);
+
+    /**
+     * Also write a preview of each render, resampled so that its longest side is size pixels.
+     */
+    Raytracer &setThumbnail(std::string thumbnailFile, int size);
+
+    /**
+     * Save the progress of each render to the given file every intervalSeconds, and resume from it if it exists and
+     * belongs to the same output file, e.g. after a crash. The file is deleted once the image is rendered. Resuming is
+     * only meaningful if the scene, the camera and the settings are unchanged.
+     */
+    Raytracer &setCheckpoint(std::string checkpointFile, int intervalSeconds);
+
     [[nodiscard]] int getWidth() const;
     [[nodiscard]] int getHeight() const;
     [[nodiscard]] int getFov() const;
+    [[nodiscard]] const Camera &getCamera() const;
     [[nodiscard]] std::string getOutputFile() const;
+    [[nodiscard]] std::string getStatsFile() const;
+    [[nodiscard]] std::string getTraceFile() const;
     [[nodiscard]] int getAntiAliasingFactor() const;
+    [[nodiscard]] bool hasCostHeatmaps() const;
+    [[nodiscard]] bool hasTemporalReuse() const;
+    [[nodiscard]] bool hasReservoirLighting() const;
+    [[nodiscard]] int getPathTracingPasses() const;
+    [[nodiscard]] int getStripHeight() const;
+    [[nodiscard]] Filter getFilter() const;
+    [[nodiscard]] std::string getThumbnailFile() const;
+    [[nodiscard]] std::string getCheckpointFile() const;
 
+    /**
+     * Render the scene into the output file. The image is written in the background: the function returns as soon as
+     * the rendering is done, so that the next one can start.
+     */
     void render(const Scene &scene);
+
+    /**
+     * Render the frames from firstFrame to lastFrame (both included) of an animation, in a single process: the meshes
+     * and their acceleration structures are loaded once, and each frame is written in the background while the next
+     * one renders.
+     * @param update called before each frame to move the objects, after which the scene is rebuilt
+     * @param framePattern printf pattern receiving the frame number to name each output file, e.g. frames/%03d.png
+     */
+    void renderAnimation(Scene &scene, int firstFrame, int lastFrame, const FrameUpdate &update,
+                         const std::string &framePattern);
+
+    /**
+     * Render the scene from several cameras at once. The tiles of all the views are scheduled together on the thread
+     * pool, so that the cores stay busy until the last view is done, and every view shares the acceleration
+     * structures of the scene. The views are traced with the Whitted tracer alone: path tracing, reservoir lighting,
+     * temporal reuse, strips, checkpoints, thumbnails and cost heatmaps are not supported, with a warning.
+     * @param viewPattern printf pattern receiving the index of the camera to name each output file, e.g. view%02d.png
+     */
+    void renderViews(const Scene &scene, const std::vector<Camera> &cameras, const std::string &viewPattern);
+
+    /**
+     * Wait for the images still being written, then report the statistics accumulated by the process so far.
+     */
+    void finish();
 };
 
 #endif//RAYTRACER_H
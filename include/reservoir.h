@@ -0,0 +1,119 @@
+//
+// Created by michele on 19.10.26.
+//
+
+#pragma once
+
+#include "camera.h"
+#include "image.h"
+#include "lights/light.h"
+#include "scene.h"
+#include <cstdint>
+#include <vector>
+
+/**
+ Weighted reservoir: streams any number of candidate light points, keeping one of them with probability proportional
+ to its weight.
+ */
+struct Reservoir {
+    int light = -1;      ///< index in the scene of the light of the kept point, -1 if none
+    LightPoint point{};  ///< kept point
+    float target = 0;    ///< target function of the kept point, for the surface owning the reservoir
+    float weightSum = 0; ///< sum of the weights of the candidates seen
+    float count = 0;     ///< number of candidates seen
+
+    /**
+     * Consider a candidate.
+     * @param weight resampling weight of the candidate
+     * @param target target function of the candidate, for the surface owning the reservoir
+     * @param candidates number of candidates the candidate stands for, more than one when merging reservoirs
+     * @param u uniform random number deciding whether the candidate replaces the kept point
+     */
+    void update(int light, const LightPoint &point, float weight, float target, float candidates, float u);
+
+    /**
+     * @return the contribution weight of the kept point, estimating the inverse of the probability of having kept it
+     */
+    [[nodiscard]] float getWeight() const { return target > 0 && count > 0 ? weightSum / (count * target) : 0.0f; }
+};
+
+/**
+ Direct lighting of the primary hits by spatiotemporal reservoir resampling (ReSTIR).
+
+ Each primary ray keeps a reservoir of light points. CANDIDATES points are drawn from the lights, uniformly or from
+ the light tree in scenes with many lights, and one is kept with probability proportional to its unshadowed
+ contribution; it is dropped if occluded. The reservoir is merged with the one of the same pixel in the previous frame
+ and with those of a few random neighbours, each candidate re-weighted for the surface at hand, so that every pixel
+ draws on hundreds of candidates and traces only two shadow rays. Reservoirs are only merged between surfaces of
+ similar depth and orientation. The merges ignore the visibility of the reused points from the surface, the usual
+ biased variant: it trades some darkening along shadow boundaries for much less noise.
+
+ The reflected and refracted light keep the regular shading of trace_ray. The history is kept per pixel without
+ reprojection, so it helps animations with a fixed camera; after the camera moves the similarity test mostly rejects
+ it.
+ */
+class ReservoirLighting
+{
+public:
+    static constexpr int CANDIDATES = 32;     ///< light points drawn per primary hit
+    static constexpr int NEIGHBOURS = 4;      ///< reservoirs of neighbouring pixels merged into each one
+    static constexpr int RADIUS = 10;         ///< maximum distance of the neighbours, in supersampled pixels
+    static constexpr float MAX_HISTORY = 20.0f;///< maximum candidates carried from the previous frame, per candidate drawn
+
+private:
+    /**
+     * Primary hit of a pixel.
+     */
+    struct Surface {
+        glm::vec3 point;
+        glm::vec3 normal;
+        glm::vec3 view;///< unit direction towards the camera
+        glm::vec3 albedo;
+        glm::vec3 specular;
+        float shininess;
+        float depth;
+        bool valid;///< false if the ray hit nothing or an object without a material
+    };
+
+    /**
+     * What the next frame needs to know of a primary hit to reuse its reservoir.
+     */
+    struct History {
+        glm::vec3 normal;
+        float depth;
+        bool valid;
+    };
+
+    int width = 0;
+    int height = 0;
+    int layers = 0;
+    size_t lightCount = 0;
+    uint32_t frame = 0;
+
+    std::vector<Surface> surfaces;    ///< primary hits of the layer being rendered
+    std::vector<glm::vec3> base;      ///< light of each primary hit other than the direct light
+    std::vector<Reservoir> reservoirs;///< reservoirs of the layer being rendered, before the spatial reuse
+    std::vector<Reservoir> previous;  ///< final reservoirs of every layer, from the previous frame until replaced
+    std::vector<History> history;
+
+    [[nodiscard]] static glm::vec3 contribution(const Light &light, const LightPoint &point, const Surface &surface);
+    [[nodiscard]] static float luminance(const glm::vec3 &color) { return (color.r + color.g + color.b) / 3.0f; }
+    [[nodiscard]] static bool isSimilar(const Surface &surface, const glm::vec3 &normal, float depth);
+
+    /**
+     * Trace the primary rays of one lens sample of every pixel, and fill their reservoirs with new candidates and
+     * with those of the previous frame.
+     */
+    void sampleLayer(const Scene &scene, const Camera &camera, int layer, bool reuseHistory);
+
+    /**
+     * Merge the reservoirs of each pixel with those of its neighbours, and shade the primary hits with them.
+     */
+    void resolveLayer(const Scene &scene, int layer, Image &image);
+
+public:
+    /**
+     * Render the next frame, accumulating each lens sample of each pixel into the supersampled image.
+     */
+    void render(const Scene &scene, const Camera &camera, Image &image);
+};
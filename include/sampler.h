@@ -0,0 +1,55 @@
+//
+// Created by michele on 19.10.26.
+//
+
+#pragma once
+
+#include "glm/glm.hpp"
+#include <cstdint>
+
+/**
+ Deterministic stream of uniform random numbers.
+
+ The stream depends only on the seed, e.g. the coordinates of a pixel and the index of one of its samples, and not on
+ the thread, the order or the process tracing it: the same sample always takes the same path, so a render can be
+ split, interrupted and resumed and still produce the same image.
+ */
+class Sampler
+{
+private:
+    uint32_t state;
+
+    /**
+     * Integer hash with good avalanche (lowbias32 by Chris Wellons).
+     */
+    static uint32_t hash(uint32_t x)
+    {
+        x ^= x >> 16;
+        x *= 0x7feb352dU;
+        x ^= x >> 15;
+        x *= 0x846ca68bU;
+        x ^= x >> 16;
+        return x;
+    }
+
+public:
+    Sampler(uint32_t x, uint32_t y, uint32_t index) : state(hash(hash(hash(x) ^ y) ^ index)) {}
+
+    /**
+     * @return a number uniformly distributed in [0, 1)
+     */
+    float next()
+    {
+        state = hash(state + 0x9e3779b9U);
+        return (float) (state >> 8) * (1.0f / 16777216.0f);
+    }
+
+    /**
+     * @return a point uniformly distributed in [0, 1)^2
+     */
+    glm::vec2 next2D()
+    {
+        const float u = next();
+        return {u, next()};
+    }
+};
@@ -4,12 +4,19 @@
 
 #pragma once
 
+#include "lights/grid.h"
 #include "lights/light.h"
 #include "lights/surface.h"
+#include "lights/tree.h"
 #include "objects/object.h"
+#include "stats.h"
+#include "trace.h"
 #include "tracers/naive.h"
 #include "tracers/tracer.h"
+#include <functional>
+#include <iostream>
 #include <memory>
+#include <optional>
 #include <vector>
 
 class SceneBuilder
@@ -51,6 +58,10 @@ class Scene
 private:
     std::vector<std::shared_ptr<Light>> lights;
     std::shared_ptr<Tracer> tracer;
+    std::shared_ptr<LightTree> lightTree;
+    std::shared_ptr<LightGrid> lightGrid;///< lights reaching each region, if lightCutoff is set
+    float lightCutoff = 0;
+    std::function<std::shared_ptr<Tracer>(std::vector<std::shared_ptr<Object>> &)> buildTracer;
 
     const glm::vec3 ambient_light = glm::vec3(0.001f);
 
@@ -62,14 +73,64 @@ public:
      * Setup the scene using the lambda provided.
      *
      * @param func a lambda that takes a SceneBuilder as argument and any other custom optional argument
+     * @param report whether to print the report of the acceleration structure
      */
     template<typename T>
-    void setup(const std::function<void(SceneBuilder &)> &func)
+    void setup(const std::function<void(SceneBuilder &)> &func, bool report = true)
     {
+        TRACE_SCOPE("scene_setup");
+        std::optional<ScopedTimer> timer(Phase::SCENE_SETUP);
         SceneBuilder builder;
         func(builder);
         lights = std::move(builder.lights);
-        tracer = std::make_unique<T>(builder.objects);
+        buildTracer = [](std::vector<std::shared_ptr<Object>> &objects) { return std::make_shared<T>(objects); };
+        // The meshes built by func are timed as acceleration build by their own nested timers, the scene below too
+        timer.reset();
+        {
+            ScopedTimer buildTimer(Phase::ACCELERATION_BUILD);
+            tracer = buildTracer(builder.objects);
+            lightTree = std::make_shared<LightTree>(lights);
+            lightGrid = lightCutoff > 0 ? std::make_shared<LightGrid>(lights, lightCutoff) : nullptr;
+        }
+        if (report)
+            getTracerStats().print(std::cout);
+    }
+
+    /**
+     * Rebuild the acceleration structures over the objects and the lights of the scene after some of them moved. The
+     * structures of the meshes, built once by Mesh::initializeTracer, are kept.
+     */
+    void rebuild()
+    {
+        TRACE_SCOPE("scene_rebuild");
+        ScopedTimer timer(Phase::ACCELERATION_BUILD);
+        std::vector<std::shared_ptr<Object>> &objects = tracer->getObjects();
+        // Bounding boxes are computed lazily: refresh them here rather than concurrently from the render threads
+        for (const auto &object : objects) {
+            object->getBoundingBox();
+        }
+        tracer = buildTracer(objects);
+        lightTree = std::make_shared<LightTree>(lights);
+        lightGrid = lightCutoff > 0 ? std::make_shared<LightGrid>(lights, lightCutoff) : nullptr;
+    }
+
+    /**
+     * Ignore each light where its intensity, attenuated with the square of the distance, falls below threshold, so that
+     * lights out of range cost nothing. 0, the default, keeps every light everywhere.
+     */
+    Scene &setLightCutoff(float threshold)
+    {
+        lightCutoff = threshold;
+        lightGrid = threshold > 0 ? std::make_shared<LightGrid>(lights, threshold) : nullptr;
+        return *this;
+    }
+
+    /**
+     * @return the report of the acceleration structure over the objects of the scene
+     */
+    [[nodiscard]] TracerStats getTracerStats() const
+    {
+        return tracer->getStats();
     }
 
     [[nodiscard]] std::optional<Hit> intersect(const Ray &ray) const
@@ -77,8 +138,25 @@ public:
         return tracer->trace(ray);
     }
 
+    /**
+     * Test which rays of a batch leaving the same point are blocked before reaching their target.
+     */
+    void traceShadows(const ShadowBatch &batch, std::vector<bool> &occluded) const
+    {
+        tracer->traceShadows(batch, occluded);
+    }
+
     [[nodiscard]] const std::vector<std::shared_ptr<Light>> &getLights() const { return lights; }
 
+    [[nodiscard]] const LightTree &getLightTree() const { return *lightTree; }
+
+    /**
+     * @return the lights reaching each region of the scene, null if every light reaches everywhere
+     */
+    [[nodiscard]] const LightGrid *getLightGrid() const { return lightGrid.get(); }
+
+    [[nodiscard]] const std::vector<std::shared_ptr<Object>> &getObjects() const { return tracer->getObjects(); }
+
     [[nodiscard]] const glm::vec3 &getAmbientLight() const
     {
         return ambient_light;
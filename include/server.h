@@ -0,0 +1,75 @@
+//
+// Created by michele on 19.10.26.
+//
+
+#pragma once
+
+#include "scene.h"
+#include "socket.h"
+#include <atomic>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ Long-running render process keeping scenes, with their meshes and acceleration structures, in memory between
+ requests, served on a Unix domain socket.
+
+ Each request is one line of words separated by spaces; each reply starts with a line "OK ..." or "ERROR <message>":
+ - SCENES: "OK" followed by the names of the scenes that can be loaded
+ - LOAD <scene>: build the scene if it is not resident yet, "OK <seconds spent>"
+ - RENDER <scene> <width> <height> <samples> <format> <x> <y> <z> <target x> <target y> <target z> <fov>: render the
+   loaded scene from a camera at (x, y, z) looking at the target, with samples lens samples per pixel; "OK <size>"
+   followed by size bytes of the image encoded as png, ppm or pfm. Sizes up to MAX_IMAGE_SIZE and up to MAX_SAMPLES
+   samples are accepted
+ - UNLOAD <scene>: release the scene, "OK"
+ - QUIT: close the connection
+ - SHUTDOWN: stop the server
+ */
+class RenderServer
+{
+public:
+    using SceneSetup = std::function<void(Scene &)>;
+
+    static constexpr int MAX_IMAGE_SIZE = 8192;///< largest width and height of a RENDER request
+    static constexpr int MAX_SAMPLES = 1024;   ///< most lens samples per pixel of a RENDER request
+
+private:
+    std::map<std::string, SceneSetup> definitions;
+    std::map<std::string, std::shared_ptr<Scene>> scenes;///< resident scenes
+    std::mutex scenesMutex;                              ///< guards scenes, held while loading one
+    std::mutex renderMutex;                              ///< a render uses every core: run one at a time
+
+    Socket listener;
+    std::atomic<bool> running{false};
+    std::mutex clientsMutex;
+    std::vector<std::thread> clientThreads;
+    std::vector<int> clientDescriptors;         ///< connections to shut down when the server stops
+    std::vector<std::thread::id> finishedClients;///< threads of closed connections, to be joined
+
+    void serveClient(Socket client);
+
+    /**
+     * Execute one request and send its reply. @return false to close the connection
+     */
+    bool handle(Socket &client, const std::string &request);
+
+    [[nodiscard]] std::shared_ptr<Scene> getScene(const std::string &name);
+
+public:
+    /**
+     * Make a scene available to the clients under the given name, built on its first LOAD, e.g. calling
+     * scene.setup<NaiveTracer>(sceneDefinition).
+     */
+    RenderServer &addScene(const std::string &name, SceneSetup setup);
+
+    /**
+     * Serve requests on a Unix domain socket created at path, until a client sends SHUTDOWN.
+     * @return false if the socket cannot be created
+     */
+    bool serve(const std::string &path);
+};
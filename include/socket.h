@@ -0,0 +1,84 @@
+//
+// Created by michele on 19.10.26.
+//
+
+#pragma once
+
+#include <cstddef>
+#include <optional>
+#include <string>
+
+/**
+ Connected or listening stream socket, either local (Unix domain) or TCP. Closed on destruction; movable only.
+
+ Failures are reported on std::cerr and through the return values: an invalid socket, false or nullopt.
+ */
+class Socket
+{
+private:
+    int fd = -1;
+    std::string buffer;///< bytes received but not consumed yet
+
+public:
+    Socket() = default;
+    explicit Socket(int fd) : fd(fd) {}
+    ~Socket();
+
+    Socket(Socket &&other) noexcept;
+    Socket &operator=(Socket &&other) noexcept;
+    Socket(const Socket &) = delete;
+    Socket &operator=(const Socket &) = delete;
+
+    /**
+     * Listen on a Unix domain socket at path, replacing a stale socket file.
+     */
+    static Socket listenLocal(const std::string &path);
+    static Socket connectLocal(const std::string &path);
+
+    /**
+     * Listen on a TCP port of every interface; port 0 picks a free one, see getPort().
+     */
+    static Socket listenTCP(int port);
+    static Socket connectTCP(const std::string &host, int port);
+
+    /**
+     * Connect to an address written as host:port for TCP, or as a path for a Unix domain socket.
+     */
+    static Socket connect(const std::string &address);
+
+    /**
+     * Listen on an address written as [host]:port for TCP (on every interface), or as a path for a Unix domain socket.
+     */
+    static Socket listen(const std::string &address);
+
+    [[nodiscard]] bool isValid() const { return fd >= 0; }
+    [[nodiscard]] int getDescriptor() const { return fd; }
+    [[nodiscard]] int getPort() const;
+
+    /**
+     * Wait for a connection on a listening socket.
+     */
+    Socket accept() const;
+
+    /**
+     * @return the next line without its terminating newline, or nullopt if the peer closed the connection
+     */
+    std::optional<std::string> readLine();
+
+    /**
+     * Read exactly size bytes. @return false if the connection was closed before
+     */
+    bool readExact(void *data, size_t size);
+
+    /**
+     * Send all the bytes. @return false if the connection was closed
+     */
+    bool writeAll(const void *data, size_t size);
+    bool writeLine(const std::string &line);
+
+    /**
+     * Stop both directions, waking up a thread blocked on the socket.
+     */
+    void shutdown();
+    void close();
+};
@@ -0,0 +1,166 @@
+//
+// Created by michele on 19.10.26.
+//
+
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <ostream>
+#include <string>
+
+/**
+ * Events counted while rendering.
+ */
+enum class Counter {
+    PRIMARY_RAYS,
+    REFLECTION_RAYS,
+    REFRACTION_RAYS,
+    SHADOW_RAYS,
+    NODE_VISITS,
+    PRIMITIVE_TESTS,
+    COUNT
+};
+
+/**
+ * Phases of a render whose wall-clock time is measured. The phases up to IMAGE_OUTPUT run one after the other; the
+ * following ones overlap with them and are not part of their sum.
+ */
+enum class Phase {
+    SCENE_SETUP,
+    ACCELERATION_BUILD,
+    RENDER,
+    IMAGE_OUTPUT,
+    BACKGROUND_OUTPUT,///< images written by a background thread while the next frame renders
+    BATCH,            ///< whole render batches, whose jobs set up, render and write their images at the same time
+    COUNT
+};
+
+/**
+ * Process-wide performance statistics.
+ *
+ * Counters are incremented in a per-thread slot padded to a cache line, so that the hot path never shares a line
+ * with another thread; the slots are merged only when the statistics are read. Phase times are measured with a
+ * monotonic wall clock, so they are not inflated by the number of OpenMP threads like clock() is.
+ */
+class Stats
+{
+public:
+    static constexpr size_t CACHE_LINE_SIZE = 64;
+    static constexpr size_t NUM_COUNTERS = (size_t) Counter::COUNT;
+    static constexpr size_t NUM_PHASES = (size_t) Phase::COUNT;
+
+    struct alignas(CACHE_LINE_SIZE) ThreadSlot {
+        std::array<uint64_t, NUM_COUNTERS> counters{};
+        int maxDepth = 0;///< deepest ray recursion reached since the last reset of this field
+    };
+
+private:
+    std::deque<ThreadSlot> slots;///< one slot per thread that ever incremented a counter, addresses are stable
+    std::array<double, NUM_PHASES> phaseSeconds{};
+    mutable std::mutex mutex;///< guards slot registration and phase times, never taken on the hot path
+
+    Stats() = default;
+
+    ThreadSlot &registerThread();
+
+public:
+    Stats(const Stats &) = delete;
+    Stats &operator=(const Stats &) = delete;
+
+    static Stats &get();
+
+    /**
+     * @return the slot of the calling thread; the cost of a piece of work done by the thread is the difference of
+     * its counters before and after it
+     */
+    static ThreadSlot &local()
+    {
+        thread_local ThreadSlot *slot = nullptr;
+        if (!slot)
+            slot = &get().registerThread();
+        return *slot;
+    }
+
+    /**
+     * Increment a counter in the slot of the calling thread.
+     */
+    static void increment(const Counter counter, const uint64_t amount = 1)
+    {
+        local().counters[(size_t) counter] += amount;
+    }
+
+    /**
+     * Record that the calling thread reached the given ray recursion depth.
+     */
+    static void recordDepth(const int depth)
+    {
+        ThreadSlot &slot = local();
+        if (depth > slot.maxDepth)
+            slot.maxDepth = depth;
+    }
+
+    void addPhaseTime(Phase phase, double seconds);
+
+    /**
+     * @return the sum of the counter over all threads
+     */
+    [[nodiscard]] uint64_t getCounter(Counter counter) const;
+
+    [[nodiscard]] double getPhaseTime(Phase phase) const;
+
+    /**
+     * @return the number of rays of any kind traced so far
+     */
+    [[nodiscard]] uint64_t getTotalRays() const;
+
+    /**
+     * Zero all counters and phase times. Must not be called while other threads are rendering.
+     */
+    void reset();
+
+    void print(std::ostream &out) const;
+
+    void writeJSON(const std::string &path) const;
+
+    static const char *getName(Counter counter);
+    static const char *getName(Phase phase);
+};
+
+/**
+ * Adds the wall-clock time between its construction and destruction to a phase. The time spent in timers nested in
+ * it on the same thread is counted only in their own phase, so that the sequential phases never overlap and sum up to
+ * the total.
+ */
+class ScopedTimer
+{
+private:
+    const Phase phase;
+    const std::chrono::steady_clock::time_point start;
+    ScopedTimer *const parent;///< innermost timer of the thread when this one started
+    double nested = 0;        ///< seconds spent in the timers nested in this one
+
+    static ScopedTimer *&current()
+    {
+        thread_local ScopedTimer *timer = nullptr;
+        return timer;
+    }
+
+public:
+    explicit ScopedTimer(Phase phase) : phase(phase), start(std::chrono::steady_clock::now()), parent(current())
+    {
+        current() = this;
+    }
+    ~ScopedTimer();
+
+    ScopedTimer(const ScopedTimer &) = delete;
+    ScopedTimer &operator=(const ScopedTimer &) = delete;
+
+    /**
+     * @return the seconds elapsed since the timer was started, including those of the nested timers
+     */
+    [[nodiscard]] double elapsed() const;
+};
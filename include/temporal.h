@@ -0,0 +1,99 @@
+//
+// Created by michele on 19.10.26.
+//
+
+#pragma once
+
+#include "camera.h"
+#include "image.h"
+#include "objects/box.h"
+#include "scene.h"
+#include <array>
+#include <limits>
+#include <optional>
+#include <unordered_map>
+#include <vector>
+
+/**
+ What the primary rays of a pixel, or of all the pixels of a tile, depend on, used to decide whether they must be traced
+ again.
+ */
+struct PixelFootprint {
+    glm::vec3 min = glm::vec3(std::numeric_limits<float>::max());  ///< bounds of the shaded primary hit points
+    glm::vec3 max = glm::vec3(-std::numeric_limits<float>::max());
+    bool secondary = false;///< whether some primary hit spawns reflection or refraction rays, whose paths are not tracked
+
+    [[nodiscard]] bool hasHits() const { return min.x <= max.x; }
+
+    void addHit(const glm::vec3 &point)
+    {
+        min = glm::min(min, point);
+        max = glm::max(max, point);
+    }
+};
+
+/**
+ Keeps the previous frame of an animation, so that only the tiles affected by the objects that moved since are traced
+ again.
+
+ A tile is affected, conservatively, when the old or the new bounds of a changed object project into it, when a shadow
+ ray from one of its primary hit points towards any point of a light may cross those bounds, or when one of its
+ primary hits is reflective or transparent. Any change to an object emitting light affects the whole frame. Only
+ changes recorded by Object::getVersion are detected, so lights must not move without their object; moving the camera
+ traces the whole frame again.
+ */
+class TemporalCache
+{
+public:
+    static constexpr int TILE_SIZE = 16;///< side of a tile, in supersampled pixels
+
+private:
+    struct Snapshot {
+        uint64_t version;
+        Box bounds;
+    };
+
+    int width = 0;
+    int height = 0;
+    int tilesX = 0;
+    int tilesY = 0;
+    std::optional<Image> image;
+    std::optional<Camera> camera;///< camera of the last frame
+    std::vector<PixelFootprint> footprints;///< one per tile, so that a tile is tested once per changed object
+    std::unordered_map<const Object *, Snapshot> snapshots;///< state of the objects when the image was rendered
+
+    /**
+     * Record the current state of the objects of the scene and return the bounds of those that changed, both before
+     * and after the change; nullopt if the whole frame is affected.
+     */
+    std::optional<std::vector<Box>> updateSnapshots(const Scene &scene);
+
+    [[nodiscard]] bool isAffected(const PixelFootprint &footprint, const Box &bounds, const Scene &scene) const;
+
+public:
+    /**
+     * Compare the scene with the one of the previous frame.
+     * @param width width of the supersampled image
+     * @param height height of the supersampled image
+     * @return the indices of the tiles to trace again, all of them for the first frame, after a resize or after the
+     * camera moved
+     */
+    std::vector<int> update(const Scene &scene, const Camera &camera, int width, int height);
+
+    [[nodiscard]] int getTileCount() const { return tilesX * tilesY; }
+
+    /**
+     * @return the pixel bounds {minX, minY, maxX, maxY} (exclusive max) of a tile
+     */
+    [[nodiscard]] std::array<int, 4> getTile(int tile) const;
+
+    /**
+     * @return the supersampled image of the last frame, in which the traced tiles are updated
+     */
+    Image &getImage() { return *image; }
+
+    /**
+     * @return the footprint of a tile, to which its pixels are added when it is traced
+     */
+    PixelFootprint &getFootprint(int tile) { return footprints[tile]; }
+};
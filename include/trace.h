@@ -0,0 +1,113 @@
+//
+// Created by michele on 19.10.26.
+//
+
+#pragma once
+
+#ifndef TRACE
+#define TRACE 0
+#endif
+
+#include <string>
+
+#if TRACE
+
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <vector>
+
+/**
+ * Timeline of the work done by each thread, written in the Chrome trace event format (chrome://tracing, Perfetto).
+ *
+ * Every thread appends to its own buffer, registered once under a lock on its first event; the hot path never
+ * locks. Only compiled when TRACE is 1, otherwise the TRACE_* macros expand to nothing.
+ */
+class TraceRecorder
+{
+public:
+    static constexpr int NO_ARG = -1;
+
+    struct Event {
+        const char *name;///< static string naming the event
+        int64_t start;   ///< nanoseconds since the recorder was created
+        int64_t duration;///< nanoseconds
+        int arg;         ///< optional numeric argument (row, object count...), NO_ARG if unused
+    };
+
+    struct ThreadBuffer {
+        int tid;
+        std::vector<Event> events;
+    };
+
+private:
+    const std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+    std::deque<ThreadBuffer> buffers;
+    std::mutex mutex;
+
+    TraceRecorder() = default;
+
+    ThreadBuffer &registerThread();
+
+public:
+    static TraceRecorder &get();
+
+    static ThreadBuffer &local()
+    {
+        thread_local ThreadBuffer *buffer = nullptr;
+        if (!buffer)
+            buffer = &get().registerThread();
+        return *buffer;
+    }
+
+    [[nodiscard]] int64_t now() const
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - epoch).count();
+    }
+
+    /**
+     * Write all the events recorded so far as a Chrome trace JSON file.
+     */
+    void write(const std::string &path);
+};
+
+/**
+ * Records an event spanning its lifetime in the buffer of the calling thread.
+ */
+class TraceScope
+{
+private:
+    const char *const name;
+    const int arg;
+    const int64_t start;
+
+public:
+    explicit TraceScope(const char *name, int arg = TraceRecorder::NO_ARG)
+        : name(name), arg(arg), start(TraceRecorder::get().now())
+    {
+    }
+
+    ~TraceScope()
+    {
+        TraceRecorder::local().events.push_back({name, start, TraceRecorder::get().now() - start, arg});
+    }
+
+    TraceScope(const TraceScope &) = delete;
+    TraceScope &operator=(const TraceScope &) = delete;
+};
+
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+#define TRACE_SCOPE(...) TraceScope TRACE_CONCAT(traceScope, __LINE__)(__VA_ARGS__)
+
+#else
+
+#define TRACE_SCOPE(...)
+
+#endif
+
+/**
+ * Write the recorded timeline to path; without TRACE only prints a warning.
+ */
+void writeTrace(const std::string &path);
@@ -28,7 +28,7 @@ public:
     {
         axis = LEAF;
         numObjects |= ((int) nodeIndices.size() << 2);
-        if (numObjects == 1) {
+        if (nodeIndices.size() == 1) {
             singleObject = nodeIndices[0];
         } else {
             objectIndicesOffset = (int) treeObjectIndices.size();
@@ -83,12 +83,20 @@ class KDTreeTracer: public Tracer {
 public:
     [[nodiscard]] std::optional<Hit> trace(const Ray &ray) const override;
 
+    /**
+     * Trace the batch down the tree together: each node computes the offset of its split from the shared origin once,
+     * and is crossed by all the rays at once when the segments of the batch lie on one side of its split.
+     */
+    void traceShadows(const ShadowBatch &batch, std::vector<bool> &occluded) const override;
+
     KDTreeTracer() = default;
 
     explicit KDTreeTracer(std::vector<std::shared_ptr<Object>> &objects);
 
     ~KDTreeTracer() override = default;
 
+    [[nodiscard]] TracerStats getStats() const override;
+
 private:
     static constexpr int MAX_OBJECTS_PER_NODE = 8;
     std::vector<KDTreeNode> nodes;
@@ -98,4 +106,25 @@ private:
     void construct(int nodeIndex, int depth, std::vector<int> obj_indices);
 
     [[nodiscard]] std::optional<Hit> traverse(const Ray &ray, size_t currentNodeIdx, float tmin, float tmax) const;
+
+    /**
+     * Part of a shadow ray within a node.
+     */
+    struct ShadowSpan {
+        int ray;
+        float tmin;
+        float tmax;
+    };
+
+    /**
+     * Trace the spans in [begin, end) of spans through the subtree of the node; the spans of the children are pushed
+     * after them, and popped before returning.
+     */
+    void traverseShadows(ShadowRays &rays, int nodeIndex, std::vector<ShadowSpan> &spans, size_t begin,
+                         size_t end) const;
+
+    /**
+     * Accumulate the statistics of the subtree rooted at the given node, whose extent is bounds.
+     */
+    void collectStats(int nodeIndex, int depth, const Box &bounds, double rootArea, TracerStats &stats) const;
 };
@@ -13,4 +13,6 @@ public:
     explicit NaiveTracer(std::vector<std::shared_ptr<Object>> &objects) : Tracer(objects) {}
 
     [[nodiscard]] std::optional<Hit> trace(const Ray &ray) const override;
+
+    [[nodiscard]] TracerStats getStats() const override;
 };
@@ -5,15 +5,80 @@
 #pragma once
 
 #include "objects/object.h"
+#include <cstddef>
+#include <map>
 #include <memory>
 #include <optional>
+#include <ostream>
+#include <string>
 #include <vector>
 
+/**
+ * Quality and memory report of an acceleration structure.
+ */
+struct TracerStats {
+    static constexpr float SAH_TRAVERSAL_COST = 1.0f;   ///< cost of visiting an inner node
+    static constexpr float SAH_INTERSECTION_COST = 1.0f;///< cost of testing a primitive
+
+    std::string name;                    ///< name of the structure
+    size_t objects = 0;                  ///< number of objects stored
+    size_t nodes = 0;                    ///< number of nodes, inner and leaf
+    size_t leaves = 0;                   ///< number of leaf nodes
+    int maxDepth = 0;                    ///< depth of the deepest leaf
+    double averageDepth = 0;             ///< average depth of the leaves
+    std::map<size_t, size_t> occupancy;  ///< number of leaves holding a given number of objects
+    size_t references = 0;               ///< number of object references over all leaves
+    double sahCost = 0;                  ///< expected cost of a ray according to the surface area heuristic
+    size_t nodeBytes = 0;                ///< memory allocated for the nodes
+    size_t indexBytes = 0;               ///< memory allocated for the leaf object index lists
+
+    /**
+     * @return the average number of leaves referencing each object, 1 if no object is duplicated
+     */
+    [[nodiscard]] double getDuplicationFactor() const;
+
+    void print(std::ostream &out) const;
+
+    [[nodiscard]] std::string toJSON() const;
+
+    void writeJSON(const std::string &path) const;
+};
+
+/**
+ * Shadow rays leaving the same point towards some points of one light, traced together.
+ */
+struct ShadowBatch {
+    glm::vec3 origin;
+    std::vector<glm::vec3> targets;
+    const Object *light = nullptr;///< object of the light, which only hides its own points from the other side
+};
+
 class Tracer
 {
 protected:
     std::vector<std::shared_ptr<Object>> objects;
 
+    /**
+     * A batch being traced: the direction, its reciprocal and the length of each ray, the bounds of all the segments
+     * and which rays are already known to be blocked.
+     */
+    struct ShadowRays {
+        const ShadowBatch &batch;
+        std::vector<glm::vec3> directions;
+        std::vector<glm::vec3> inverses;
+        std::vector<float> lengths;
+        Box bounds;
+        std::vector<bool> &occluded;
+
+        ShadowRays(const ShadowBatch &batch, std::vector<bool> &occluded);
+    };
+
+    /**
+     * Test an object against the given rays of a batch, marking those it blocks. The offsets of the box of the object
+     * from the shared origin are computed once for all the rays.
+     */
+    static void testShadows(ShadowRays &rays, Object &object, const int *indices, size_t count);
+
 public:
     Tracer();
     explicit Tracer(std::vector<std::shared_ptr<Object>> &objects);
@@ -22,4 +87,16 @@ public:
     [[nodiscard]] std::vector<std::shared_ptr<Object>> &getObjects();
 
     [[nodiscard]] virtual std::optional<Hit> trace(const Ray &ray) const = 0;
+
+    /**
+     * Test which rays of a batch are blocked before reaching their target, filling occluded with one entry per
+     * target. Any hit is enough to block a ray, so a ray leaves the traversal as soon as it is blocked. By default
+     * every object is tested against every ray.
+     */
+    virtual void traceShadows(const ShadowBatch &batch, std::vector<bool> &occluded) const;
+
+    /**
+     * @return the report of the acceleration structure; by default a single leaf containing every object
+     */
+    [[nodiscard]] virtual TracerStats getStats() const;
 };
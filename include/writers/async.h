@@ -0,0 +1,55 @@
+//
+// Created by michele on 19.10.26.
+//
+
+#pragma once
+
+#include "image.h"
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+
+/**
+ Writes images on a background thread, so that the caller can go on rendering while the previous image is encoded.
+ The images are written in submission order; the destructor waits for the pending ones. At most maxQueued images
+ wait to be written, further submissions block, so that a long animation cannot pile up frames in memory.
+ */
+class AsyncImageWriter
+{
+private:
+    struct Job {
+        Image image;
+        std::string path;
+        ToneMapping toneMapping;
+    };
+
+    const size_t maxQueued;
+    std::deque<Job> queue;
+    bool stopping = false;
+    bool busy = false;
+    std::mutex mutex;
+    std::condition_variable wakeUp;///< signalled when a job is queued or the writer stops
+    std::condition_variable idle;  ///< signalled when a job is taken from the queue or the queue has been drained
+    std::thread thread;
+
+    void run();
+
+public:
+    explicit AsyncImageWriter(size_t maxQueued = 2);
+    ~AsyncImageWriter();
+
+    AsyncImageWriter(const AsyncImageWriter &) = delete;
+    AsyncImageWriter &operator=(const AsyncImageWriter &) = delete;
+
+    /**
+     * Queue an image to be written to path, in the format given by its extension, waiting first if the queue is full.
+     */
+    void submit(Image image, std::string path, ToneMapping toneMapping = nullptr);
+
+    /**
+     * Block until every submitted image has been written.
+     */
+    void wait();
+};
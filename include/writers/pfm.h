@@ -0,0 +1,36 @@
+//
+// Created by michele on 19.10.26.
+//
+
+#pragma once
+
+#include "writer.h"
+
+/**
+ Portable float map writer, storing the linear radiance without tone mapping. The rows are stored from bottom to top:
+ rows appended with writeRows are placed at their final offset, so the stream must be seekable, while whole images
+ are written sequentially.
+ */
+class PFMWriter: public ImageWriter
+{
+private:
+    std::streamoff dataOffset = 0;///< stream offset of the first pixel
+    int nextRow = 0;               ///< index, from the top, of the next row to write
+    std::vector<float> buffer;
+
+    /**
+     * Convert rows to floats in buffer, from the last row to the first.
+     */
+    void pack(const glm::vec3 *pixels, int count);
+
+protected:
+    void writeBlocks(const Image &image) override;
+
+public:
+    PFMWriter() = default;
+
+    using ImageWriter::open;
+    void open(std::ostream &stream, int width, int height) override;
+    void writeRows(const glm::vec3 *pixels, int count) override;
+    [[nodiscard]] std::streamoff getEncodedSize() const override;
+};
@@ -0,0 +1,63 @@
+//
+// Created by michele on 19.10.26.
+//
+
+#pragma once
+
+#include "writer.h"
+#include <cstdint>
+
+/**
+ Dependency-free 8-bit RGB PNG writer.
+
+ Each block of rows is filtered and split into horizontal strips that are deflated in parallel, each into
+ independent fixed-Huffman blocks terminated by a sync flush; the strips are then stitched in order into one zlib
+ stream, combining their Adler-32 checksums.
+ */
+class PNGWriter: public ImageWriter
+{
+private:
+    static constexpr int STRIP_ROWS = 16;///< rows compressed by a single thread
+
+    struct Strip {
+        std::vector<uint8_t> bytes;///< deflate blocks, ending at a byte boundary
+        uint32_t adler = 1;        ///< Adler-32 of the uncompressed strip
+        size_t length = 0;         ///< length of the uncompressed strip
+    };
+
+    const ToneMapping toneMapping;
+    std::vector<uint8_t> previousRow;///< last quantised row of the previous block, used by the filters
+    uint32_t adler = 1;              ///< Adler-32 of the whole uncompressed stream so far
+    bool firstData = true;
+
+    void writeChunk(const char *type, const uint8_t *data, size_t size);
+
+    /**
+     * Choose the filter of a row minimising the sum of absolute differences, and write the filtered row.
+     * @param row quantised row
+     * @param previous quantised row above it, or null for the first row of the image
+     * @param out 1 + 3 * width bytes: filter type followed by the filtered row
+     */
+    void filterRow(const uint8_t *row, const uint8_t *previous, uint8_t *out) const;
+
+    static Strip compress(const uint8_t *data, size_t size);
+
+protected:
+    [[nodiscard]] int getBlockRows() const override { return 256; }
+
+public:
+    explicit PNGWriter(ToneMapping toneMapping = nullptr) : toneMapping(toneMapping) {}
+
+    using ImageWriter::open;
+    void open(std::ostream &stream, int width, int height) override;
+    void writeRows(const glm::vec3 *pixels, int count) override;
+    void close() override;
+
+    static uint32_t crc32(uint32_t crc, const uint8_t *data, size_t size);
+    static uint32_t adler32(uint32_t adler, const uint8_t *data, size_t size);
+
+    /**
+     * @return the Adler-32 of the concatenation of two buffers given their checksums and the length of the second
+     */
+    static uint32_t adler32Combine(uint32_t first, uint32_t second, size_t secondLength);
+};
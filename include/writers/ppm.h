@@ -0,0 +1,24 @@
+//
+// Created by michele on 19.10.26.
+//
+
+#pragma once
+
+#include "writer.h"
+
+/**
+ Binary 8-bit PPM (P6) writer.
+ */
+class PPMWriter: public ImageWriter
+{
+private:
+    const ToneMapping toneMapping;
+    std::vector<unsigned char> buffer;
+
+public:
+    explicit PPMWriter(ToneMapping toneMapping = nullptr) : toneMapping(toneMapping) {}
+
+    using ImageWriter::open;
+    void open(std::ostream &stream, int width, int height) override;
+    void writeRows(const glm::vec3 *pixels, int count) override;
+};
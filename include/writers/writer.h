@@ -0,0 +1,90 @@
+//
+// Created by michele on 19.10.26.
+//
+
+#pragma once
+
+#include "glm/glm.hpp"
+#include "image.h"
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+
+/**
+ Streaming image writer: the header is written on open, then rows are appended from top to bottom in blocks. The
+ image goes either to a file or to any stream, e.g. to send it over a socket. Formats that store the rows in another
+ order may need a seekable stream for writeRows, but write the whole images of write() sequentially.
+ */
+class ImageWriter
+{
+protected:
+    std::ofstream file;      ///< output file, when opened from a path
+    std::ostream *out = &file;///< destination of the writes
+    int width = 0;
+    int height = 0;
+
+    /**
+     * @return the number of rows resolved and written at once by write()
+     */
+    [[nodiscard]] virtual int getBlockRows() const { return 64; }
+
+    /**
+     * Tone map, clamp and quantise pixels to 8-bit RGB triplets.
+     */
+    static void quantize(const glm::vec3 *pixels, size_t count, ToneMapping toneMapping, unsigned char *out);
+
+    /**
+     * Write the rows of the image in blocks of getBlockRows(), then close.
+     */
+    virtual void writeBlocks(const Image &image);
+
+public:
+    ImageWriter() = default;
+    virtual ~ImageWriter() = default;
+
+    /**
+     * Create the file and write its header.
+     */
+    void open(const std::string &path, int width, int height);
+
+    /**
+     * Write the header to stream, to which the rows will be appended.
+     */
+    virtual void open(std::ostream &stream, int width, int height);
+
+    /**
+     * Append rows of linear radiance, continuing from the last row written.
+     * @param pixels count * width row-major pixels
+     * @param count number of rows
+     */
+    virtual void writeRows(const glm::vec3 *pixels, int count) = 0;
+
+    virtual void close();
+
+    /**
+     * @return the size in bytes of the whole encoded image, once opened, or -1 if it depends on the pixels
+     */
+    [[nodiscard]] virtual std::streamoff getEncodedSize() const { return -1; }
+
+    /**
+     * Write a whole image to path.
+     */
+    void write(const Image &image, const std::string &path);
+
+    /**
+     * Write a whole image to stream.
+     */
+    void write(const Image &image, std::ostream &stream);
+
+    /**
+     * @return a writer for the format given by the extension of path (.png, .ppm or .pfm), PNG if unknown
+     * @param toneMapping operator applied before quantisation by low dynamic range formats
+     */
+    static std::unique_ptr<ImageWriter> create(const std::string &path, ToneMapping toneMapping = nullptr);
+
+    /**
+     * @return a writer for the format given by its usual extension (png, ppm or pfm), or null if unknown
+     */
+    static std::unique_ptr<ImageWriter> createForFormat(const std::string &format, ToneMapping toneMapping = nullptr);
+};
@@ -2,6 +2,7 @@
 @file main.cpp
 */
 
+#include "distributed.h"
 #include "image.h"
 #include "lights/light.h"
 #include "loaders/loader.h"
@@ -9,9 +10,11 @@
 #include "objects/mesh.h"
 #include "objects/object.h"
 #include "objects/plane.h"
+#include "objects/sphere.h"
 #include "ray.h"
 #include "raytracer.h"
 #include "scene.h"
+#include "server.h"
 #include "textures.h"
 
 #include "tracers/kdtree.h"
@@ -30,11 +33,15 @@
 #include <map>
 #include <memory>
 #include <optional>
+#include <string>
 #include <vector>
 
 #define VOID_COLOR_RGB 0, 0, 0
 #define SCENE_Z 1.0f
 #define MAX_RAY_DEPTH 10
+#define FRAME_RATE 40.0f
+#define BALL_RADIUS 1.5f
+#define BALL_MAX_HEIGHT 8.0f
 
 using namespace std;
 
@@ -42,6 +49,21 @@ using namespace std;
 static Scene scene;
 
 
+/**
+ Move the ball bouncing on the floor to its position at the given frame
+ */
+void moveBall(Sphere &ball, int frame)
+{
+    const float t = (float) frame / FRAME_RATE;
+    const float baseHeight = -3 + BALL_RADIUS;
+    const float y = jumping_ball_position(baseHeight, BALL_MAX_HEIGHT, t, BALL_RADIUS);
+    const glm::vec3 scale = jumping_ball_scale(baseHeight, BALL_MAX_HEIGHT, t, BALL_RADIUS, 1.0f / FRAME_RATE);
+
+    glm::mat4 transformation = glm::translate(glm::mat4(1.0f), glm::vec3(-6, y, 12));
+    transformation = glm::scale(transformation, scale * BALL_RADIUS);
+    ball.setTransformation(transformation);
+}
+
 /**
  Function defining the scene
  */
@@ -73,18 +95,73 @@ void sceneDefinition(SceneBuilder &builder)
 //        builder.addLight(new PointLight(glm::vec3(0, 5, 1), glm::vec3(0.4f)));
 }
 
+/**
+ Set up the scene of sceneDefinition with a ball bouncing on the floor
+ @return the callback moving the ball to its position at a frame
+ */
+FrameUpdate setupAnimatedScene(Scene &scene)
+{
+    Sphere *ball = nullptr;
+    scene.setup<NaiveTracer>([&ball](SceneBuilder &builder) {
+        sceneDefinition(builder);
+        ball = new Sphere(MaterialFactory().build());
+        moveBall(*ball, 0);
+        builder.addObject(ball);
+    });
+    // The ball is owned by the scene, which outlives the callback
+    return [ball](Scene &, int frame) { moveBall(*ball, frame); };
+}
+
+/**
+ Usage: main [output file] [first frame] [last frame]
+        main --serve <socket path>
+        main --coordinate <address> <output pattern> [first frame] [last frame]
+        main --work <address> [--animation]
+
+ With a frame range the output file is a printf pattern receiving the frame number, e.g. frames/%03d.png, and all the
+ frames are rendered in this process. With --serve the scene is served to clients of a render server (see server.h).
+ With --coordinate the frames are split in tiles rendered by any number of --work processes connecting to the address,
+ a socket path or host:port (see distributed.h). Workers render the still scene, or with --animation the animated one
+ that the frame ranges render in this process.
+ */
 int main(int argc, const char *argv[])
 {
-    Raytracer tracer = Raytracer(1024, 768, 90).setAntiAliasing(1);
+    if (argc >= 3 && std::string(argv[1]) == "--serve") {
+        RenderServer server;
+        server.addScene("default", [](Scene &scene) { scene.setup<NaiveTracer>(sceneDefinition); });
+        return server.serve(argv[2]) ? 0 : 1;
+    }
+
+    if (argc >= 4 && std::string(argv[1]) == "--coordinate") {
+        const Raytracer settings = Raytracer(1024, 768, 90).setAntiAliasing(1);
+        const int first = argc >= 5 ? std::stoi(argv[4]) : 0;
+        const int last = argc >= 6 ? std::stoi(argv[5]) : first;
+        return RenderCoordinator(settings).render(argv[2], first, last, argv[3]) ? 0 : 1;
+    }
 
-    // Compute the size of each pixel given the FOV
-    scene.setup<NaiveTracer>(sceneDefinition);
+    if (argc >= 3 && std::string(argv[1]) == "--work") {
+        FrameUpdate update;
+        if (argc >= 4 && std::string(argv[3]) == "--animation")
+            update = setupAnimatedScene(scene);
+        else
+            scene.setup<NaiveTracer>(sceneDefinition);
+        return RenderWorker(scene, update).run(argv[2]) ? 0 : 1;
+    }
+
+    Raytracer tracer = Raytracer(1024, 768, 90).setAntiAliasing(1);
 
     if (argc >= 2) {
         tracer.setOutputFile(argv[1]);
     }
 
-    tracer.render(scene);
+    if (argc >= 4) {
+        const FrameUpdate update = setupAnimatedScene(scene);
+        tracer.renderAnimation(scene, std::stoi(argv[2]), std::stoi(argv[3]), update, tracer.getOutputFile());
+    } else {
+        scene.setup<NaiveTracer>(sceneDefinition);
+        tracer.render(scene);
+    }
+    tracer.finish();
 
     return 0;
 }
@@ -0,0 +1,80 @@
+//
+// Created by michele on 19.10.26.
+//
+
+#include "batch.h"
+#include "lightning.h"
+#include "raytracer.h"
+#include "trace.h"
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+
+RenderBatch &RenderBatch::add(RenderJob job)
+{
+    jobs.push_back(std::move(job));
+    return *this;
+}
+
+RenderBatch &RenderBatch::setAntiAliasing(const int SSAAFactor)
+{
+    this->SSAA = SSAAFactor;
+    return *this;
+}
+
+RenderBatch &RenderBatch::setFilter(const Filter filter)
+{
+    this->filter = filter;
+    return *this;
+}
+
+void RenderBatch::renderJob(const RenderJob &job) const
+{
+    if (job.setup) {
+        TRACE_SCOPE("batch_setup");
+        job.setup(*job.scene);
+    }
+
+    const int width = job.width * SSAA;
+    const int height = job.height * SSAA;
+    const int tilesX = (width + TILE_SIZE - 1) / TILE_SIZE;
+    const int tiles = tilesX * ((height + TILE_SIZE - 1) / TILE_SIZE);
+    Image image(width, height);
+
+    // The task waits for its tiles at the end of the taskloop, running tasks of other jobs meanwhile
+    #pragma omp taskloop grainsize(1) shared(image)
+    for (int tile = 0; tile < tiles; tile++) {
+        TRACE_SCOPE("tile", tile);
+        const int x = tile % tilesX * TILE_SIZE;
+        const int y = tile / tilesX * TILE_SIZE;
+        for (int j = y; j < std::min(y + TILE_SIZE, height); j++) {
+            for (int i = x; i < std::min(x + TILE_SIZE, width); i++) {
+                image.setPixel(i, j, Raytracer::renderPixel(*job.scene, job.camera, i, j, width, height, nullptr));
+            }
+        }
+    }
+
+    TRACE_SCOPE("batch_write");
+    image.downsample(SSAA, filter).writeImage(job.outputFile, tone_mapping);
+}
+
+void RenderBatch::render()
+{
+    const auto startTime = std::chrono::steady_clock::now();
+    {
+        // Not the render phase: setups and writes run in the tasks too, timed in their own phases by their threads
+        ScopedTimer timer(Phase::BATCH);
+
+        #pragma omp parallel
+        #pragma omp single
+        for (const RenderJob &job : jobs) {
+            #pragma omp task firstprivate(job)
+            renderJob(job);
+        }
+    }
+
+    const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - startTime;
+    std::cout << "It took " << elapsed.count() << " seconds to render and write " << jobs.size() << " images ("
+              << (double) jobs.size() / elapsed.count() << " images per second)." << std::endl;
+    jobs.clear();
+}
@@ -0,0 +1,113 @@
+//
+// Created by michele on 19.10.26.
+//
+
+#include "camera.h"
+#include <cmath>
+#include <limits>
+
+Camera &Camera::setPosition(const glm::vec3 &position)
+{
+    this->position = position;
+    return *this;
+}
+
+Camera &Camera::lookAt(const glm::vec3 &target, const glm::vec3 &worldUp)
+{
+    forward = glm::normalize(target - position);
+    right = glm::normalize(glm::cross(worldUp, forward));
+    up = glm::cross(forward, right);
+    return *this;
+}
+
+Camera &Camera::setFov(const float fov)
+{
+    this->fov = fov;
+    return *this;
+}
+
+Camera &Camera::setLens(const DOFParams lens)
+{
+    this->lens = lens;
+    return *this;
+}
+
+Ray Camera::generateRay(const int i, const int j, const int width, const int height, const glm::vec2 &lensSample) const
+{
+    const float pixelSize = (2.0f * tan(glm::radians(fov / 2.0f))) / width;
+
+    const float sceneLeft = (float) -width * pixelSize / 2.0f;
+    const float sceneTop = (float) height * pixelSize / 2.0f;
+
+    const float x = sceneLeft + (float) i * pixelSize + pixelSize / 2.0f;
+    const float y = sceneTop - (float) j * pixelSize - pixelSize / 2.0f;
+    const glm::vec3 direction = glm::normalize(glm::vec3(x, y, SCENE_Z));
+
+    const glm::vec3 focalPoint = lens.focalLength * direction / direction.z;
+    const glm::vec3 origin(lensSample.x * lens.aperture, lensSample.y * lens.aperture, 0);
+    const glm::vec3 local = glm::normalize(focalPoint - origin);
+
+    return {position + origin.x * right + origin.y * up,
+            glm::normalize(local.x * right + local.y * up + local.z * forward)};
+}
+
+std::optional<std::array<int, 4>> Camera::project(const Box &box, const int width, const int height) const
+{
+    const float pixelSize = (2.0f * tan(glm::radians(fov / 2.0f))) / width;
+    const float aperture = lens.aperture / 2.0f;
+
+    glm::vec2 min(std::numeric_limits<float>::max());
+    glm::vec2 max(-std::numeric_limits<float>::max());
+    for (int corner = 0; corner < 8; corner++) {
+        const glm::vec3 world((corner & 1) ? box.max.x : box.min.x, (corner & 2) ? box.max.y : box.min.y,
+                              (corner & 4) ? box.max.z : box.min.z);
+        if (!std::isfinite(world.x) || !std::isfinite(world.y) || !std::isfinite(world.z))
+            return std::nullopt;
+
+        // The camera frame is orthonormal, so the box stays convex and its projection is bounded by its corners
+        const glm::vec3 offset = world - position;
+        const glm::vec3 point(glm::dot(offset, right), glm::dot(offset, up), glm::dot(offset, forward));
+        // Points behind or too close to the lens may project anywhere
+        if (point.z <= 1e-3f)
+            return std::nullopt;
+
+        // A ray from the lens point o through the point crosses the focal plane at o + (point - o) * f / point.z,
+        // which is affine in o: the extremes are reached from the corners of the lens
+        for (int lensCorner = 0; lensCorner < 4; lensCorner++) {
+            const glm::vec3 o((lensCorner & 1) ? aperture : -aperture, (lensCorner & 2) ? aperture : -aperture, 0);
+            const glm::vec3 focal = o + (point - o) * (lens.focalLength / point.z);
+            const glm::vec2 screen = glm::vec2(focal.x, focal.y) * (SCENE_Z / lens.focalLength);
+            min = glm::min(min, screen);
+            max = glm::max(max, screen);
+        }
+    }
+
+    // Inverse of the mapping from pixels to the image plane of generateRay, with a pixel of margin
+    const float sceneLeft = (float) -width * pixelSize / 2.0f;
+    const float sceneTop = (float) height * pixelSize / 2.0f;
+    return std::array<int, 4>{(int) std::floor((min.x - sceneLeft) / pixelSize) - 1,
+                              (int) std::floor((sceneTop - max.y) / pixelSize) - 1,
+                              (int) std::ceil((max.x - sceneLeft) / pixelSize) + 1,
+                              (int) std::ceil((sceneTop - min.y) / pixelSize) + 1};
+}
+
+std::vector<Camera> Camera::orbit(const glm::vec3 &target, const float radius, const float height, const int count,
+                                  const float fov)
+{
+    std::vector<Camera> cameras;
+    cameras.reserve(count);
+    for (int k = 0; k < count; k++) {
+        const float angle = 2.0f * (float) M_PI * (float) k / (float) count;
+        // The first camera looks down +Z, like the default one
+        const glm::vec3 offset(-radius * std::sin(angle), height, -radius * std::cos(angle));
+        cameras.push_back(Camera(fov).setPosition(target + offset).lookAt(target));
+    }
+    return cameras;
+}
+
+bool Camera::operator==(const Camera &other) const
+{
+    return position == other.position && right == other.right && up == other.up && forward == other.forward &&
+           fov == other.fov && lens.samples == other.lens.samples && lens.focalLength == other.lens.focalLength &&
+           lens.aperture == other.lens.aperture;
+}
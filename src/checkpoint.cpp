@@ -0,0 +1,171 @@
+//
+// Created by michele on 19.10.26.
+//
+
+#include "checkpoint.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+namespace
+{
+
+template<typename T>
+void writeValue(std::ostream &out, const T &value)
+{
+    out.write(reinterpret_cast<const char *>(&value), sizeof(T));
+}
+
+template<typename T>
+bool readValue(std::istream &in, T &value)
+{
+    return (bool) in.read(reinterpret_cast<char *>(&value), sizeof(T));
+}
+
+}// namespace
+
+Checkpoint::Checkpoint(std::string path, std::string key, const int width, const int height)
+    : path(std::move(path)), key(std::move(key)), width(width), height(height),
+      tilesX((width + TILE_SIZE - 1) / TILE_SIZE), tilesY((height + TILE_SIZE - 1) / TILE_SIZE),
+      done((size_t) tilesX * tilesY, 0)
+{
+}
+
+std::array<int, 4> Checkpoint::getTile(const int tile) const
+{
+    const int x = (tile % tilesX) * TILE_SIZE;
+    const int y = (tile / tilesX) * TILE_SIZE;
+    return {x, y, std::min(x + TILE_SIZE, width), std::min(y + TILE_SIZE, height)};
+}
+
+void Checkpoint::markDone(const int tile)
+{
+    if (!done[tile]) {
+        done[tile] = 1;
+        completed++;
+    }
+}
+
+bool Checkpoint::load(Image &image)
+{
+    std::ifstream file(path, std::ios::binary);
+    if (!file)
+        return false;
+
+    char magic[4];
+    uint32_t version, keyLength;
+    int32_t fileWidth, fileHeight, tileSize;
+    if (!file.read(magic, sizeof(magic)) || std::memcmp(magic, MAGIC, sizeof(MAGIC)) != 0
+        || !readValue(file, version) || version != VERSION) {
+        std::cerr << path << " is not a checkpoint, ignoring it" << std::endl;
+        return false;
+    }
+    if (!readValue(file, fileWidth) || !readValue(file, fileHeight) || !readValue(file, tileSize)
+        || !readValue(file, keyLength) || keyLength > 4096)
+        return false;
+    std::string fileKey(keyLength, '\0');
+    if (!file.read(fileKey.data(), keyLength))
+        return false;
+    if (fileWidth != width || fileHeight != height || tileSize != TILE_SIZE || fileKey != key) {
+        std::cerr << path << " belongs to another render, ignoring it" << std::endl;
+        return false;
+    }
+
+    std::vector<uint8_t> bitmap((done.size() + 7) / 8);
+    if (!file.read(reinterpret_cast<char *>(bitmap.data()), (std::streamsize) bitmap.size()))
+        return false;
+
+    // Read everything before touching the image, so that a truncated file restores nothing
+    std::vector<int> tiles;
+    std::vector<float> pixels;
+    for (int tile = 0; tile < getTileCount(); tile++) {
+        if (!(bitmap[tile / 8] & (1 << (tile % 8))))
+            continue;
+        const std::array<int, 4> bounds = getTile(tile);
+        const size_t count = (size_t) (bounds[2] - bounds[0]) * (bounds[3] - bounds[1]);
+        const size_t offset = pixels.size();
+        pixels.resize(offset + 4 * count);
+        if (!file.read(reinterpret_cast<char *>(&pixels[offset]), (std::streamsize) (4 * count * sizeof(float)))) {
+            std::cerr << path << " is truncated, ignoring it" << std::endl;
+            return false;
+        }
+        tiles.push_back(tile);
+    }
+
+    const float *pixel = pixels.data();
+    for (const int tile : tiles) {
+        const std::array<int, 4> bounds = getTile(tile);
+        for (int y = bounds[1]; y < bounds[3]; y++) {
+            for (int x = bounds[0]; x < bounds[2]; x++, pixel += 4) {
+                image.setAccumulated(x, y, glm::vec3(pixel[0], pixel[1], pixel[2]), pixel[3]);
+            }
+        }
+        markDone(tile);
+    }
+    return true;
+}
+
+bool Checkpoint::save(const Image &image) const
+{
+    // Write next to the checkpoint and rename, so that a crash while saving keeps the previous one
+    const std::string temporary = path + ".tmp";
+    {
+        std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+        if (!file) {
+            std::cerr << "Cannot open " << temporary << std::endl;
+            return false;
+        }
+
+        file.write(MAGIC, sizeof(MAGIC));
+        writeValue(file, VERSION);
+        writeValue(file, (int32_t) width);
+        writeValue(file, (int32_t) height);
+        writeValue(file, (int32_t) TILE_SIZE);
+        writeValue(file, (uint32_t) key.size());
+        file.write(key.data(), (std::streamsize) key.size());
+
+        std::vector<uint8_t> bitmap((done.size() + 7) / 8, 0);
+        for (size_t tile = 0; tile < done.size(); tile++) {
+            if (done[tile])
+                bitmap[tile / 8] |= (uint8_t) (1 << (tile % 8));
+        }
+        file.write(reinterpret_cast<const char *>(bitmap.data()), (std::streamsize) bitmap.size());
+
+        std::vector<float> pixels((size_t) 4 * TILE_SIZE * TILE_SIZE);
+        for (int tile = 0; tile < getTileCount(); tile++) {
+            if (!done[tile])
+                continue;
+            const std::array<int, 4> bounds = getTile(tile);
+            float *pixel = pixels.data();
+            for (int y = bounds[1]; y < bounds[3]; y++) {
+                for (int x = bounds[0]; x < bounds[2]; x++, pixel += 4) {
+                    const glm::vec3 sum = image.getSum(x, y);
+                    pixel[0] = sum.r;
+                    pixel[1] = sum.g;
+                    pixel[2] = sum.b;
+                    pixel[3] = image.getWeight(x, y);
+                }
+            }
+            file.write(reinterpret_cast<const char *>(pixels.data()),
+                       (std::streamsize) ((pixel - pixels.data()) * sizeof(float)));
+        }
+
+        if (!file.flush()) {
+            std::cerr << "Cannot write " << temporary << std::endl;
+            return false;
+        }
+    }
+
+    if (std::rename(temporary.c_str(), path.c_str()) != 0) {
+        std::cerr << "Cannot replace " << path << std::endl;
+        return false;
+    }
+    return true;
+}
+
+void Checkpoint::remove() const
+{
+    std::remove(path.c_str());
+}
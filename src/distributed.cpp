@@ -0,0 +1,298 @@
+//
+// Created by michele on 19.10.26.
+//
+
+#include "distributed.h"
+#include "lightning.h"
+#include "trace.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <omp.h>
+#include <sstream>
+#include <sys/socket.h>
+#include <thread>
+
+RenderCoordinator &RenderCoordinator::setTileSize(const int size)
+{
+    this->tileSize = size;
+    return *this;
+}
+
+bool RenderCoordinator::render(const std::string &address, const int firstFrame, const int lastFrame,
+                               const std::string &framePattern)
+{
+    listener = Socket::listen(address);
+    if (!listener.isValid())
+        return false;
+
+    const auto startTime = std::chrono::steady_clock::now();
+    const int width = settings.getWidth() * settings.getAntiAliasingFactor();
+    const int height = settings.getHeight() * settings.getAntiAliasingFactor();
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        this->firstFrame = firstFrame;
+        this->framePattern = framePattern;
+        tiles.clear();
+        pending.clear();
+        frames.clear();
+        frames.resize(lastFrame - firstFrame + 1);
+        for (int frame = firstFrame; frame <= lastFrame; frame++) {
+            for (int y = 0; y < height; y += tileSize) {
+                for (int x = 0; x < width; x += tileSize) {
+                    pending.push_back(tiles.size());
+                    tiles.push_back({frame, x, y, std::min(tileSize, width - x), std::min(tileSize, height - y)});
+                    frames[frame - firstFrame].remaining++;
+                }
+            }
+        }
+        remainingTiles = tiles.size();
+    }
+
+    std::cout << "Waiting for workers on " << address << " to render " << tiles.size() << " tiles." << std::endl;
+    std::vector<std::thread> workers;
+    while (true) {
+        Socket worker = listener.accept();
+        if (!worker.isValid())
+            break;
+        std::lock_guard<std::mutex> lock(mutex);
+        workerDescriptors.push_back(worker.getDescriptor());
+        workers.emplace_back([this, worker = std::move(worker)]() mutable {
+            serveWorker(worker);
+            std::lock_guard<std::mutex> lock(mutex);
+            workerDescriptors.erase(std::remove(workerDescriptors.begin(), workerDescriptors.end(),
+                                                worker.getDescriptor()),
+                                    workerDescriptors.end());
+        });
+    }
+
+    // Every tile is done: wake up the workers still connected, e.g. one that never said HELLO or a straggler
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (const int descriptor : workerDescriptors) {
+            ::shutdown(descriptor, SHUT_RDWR);
+        }
+    }
+    for (auto &worker : workers) {
+        worker.join();
+    }
+    listener.close();
+    writer.wait();
+
+    const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - startTime;
+    std::cout << "It took " << elapsed.count() << " seconds to render " << lastFrame - firstFrame + 1 << " frames on "
+              << workers.size() << " workers." << std::endl;
+    return true;
+}
+
+std::optional<size_t> RenderCoordinator::takeTile()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        if (remainingTiles == 0)
+            return std::nullopt;
+
+        if (!pending.empty()) {
+            const size_t tile = pending.front();
+            pending.pop_front();
+            tiles[tile].copies++;
+            return tile;
+        }
+
+        // Steal the earliest unfinished tile with the fewest workers on it
+        std::optional<size_t> stolen;
+        for (size_t tile = 0; tile < tiles.size(); tile++) {
+            if (!tiles[tile].done && tiles[tile].copies < MAX_COPIES &&
+                (!stolen || tiles[tile].copies < tiles[*stolen].copies))
+                stolen = tile;
+        }
+        if (stolen) {
+            tiles[*stolen].copies++;
+            return stolen;
+        }
+        changed.wait(lock);
+    }
+}
+
+void RenderCoordinator::serveWorker(Socket &worker)
+{
+    const std::optional<std::string> hello = worker.readLine();
+    if (!hello || *hello != "HELLO")
+        return;
+
+    const Camera &camera = settings.getCamera();
+    const glm::vec3 position = camera.getPosition();
+    const glm::vec3 forward = camera.getForward();
+    const glm::vec3 up = camera.getUp();
+    const DOFParams &lens = camera.getLens();
+    std::ostringstream job;
+    job << std::setprecision(std::numeric_limits<float>::max_digits10) << "JOB "
+        << settings.getWidth() * settings.getAntiAliasingFactor() << " "
+        << settings.getHeight() * settings.getAntiAliasingFactor() << " " << settings.getAntiAliasingFactor() << " "
+        << position.x << " " << position.y << " " << position.z << " " << forward.x << " " << forward.y << " "
+        << forward.z << " " << up.x << " " << up.y << " " << up.z << " " << camera.getFov() << " " << lens.samples
+        << " " << lens.focalLength << " " << lens.aperture;
+    if (!worker.writeLine(job.str()))
+        return;
+
+    bool holding = false;///< whether a tile handed out to the worker has not been returned yet
+    size_t held = 0;
+    std::vector<glm::vec3> pixels;
+    while (const std::optional<std::string> line = worker.readLine()) {
+        std::istringstream words(*line);
+        std::string command;
+        words >> command;
+
+        if (command == "PIXELS" && holding) {
+            // Only the tile handed out is accepted, and its pixels are read with the size the coordinator chose
+            const Tile &expected = tiles[held];
+            Tile tile{};
+            words >> tile.frame >> tile.x >> tile.y >> tile.width >> tile.height;
+            if (!words || tile.frame != expected.frame || tile.x != expected.x || tile.y != expected.y
+                || tile.width != expected.width || tile.height != expected.height) {
+                std::cerr << "Worker returned another tile than the one handed out: " << *line << std::endl;
+                break;
+            }
+            pixels.resize((size_t) expected.width * expected.height);
+            if (!worker.readExact(pixels.data(), pixels.size() * sizeof(glm::vec3)))
+                break;
+
+            std::optional<Image> completed;
+            int completedFrame = 0;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                Tile &target = tiles[held];
+                target.copies--;
+                if (!target.done) {
+                    target.done = true;
+                    remainingTiles--;
+                    Frame &frame = frames[target.frame - firstFrame];
+                    if (!frame.image)
+                        frame.image.emplace(settings.getWidth() * settings.getAntiAliasingFactor(),
+                                            settings.getHeight() * settings.getAntiAliasingFactor());
+                    for (int j = 0; j < target.height; j++) {
+                        for (int i = 0; i < target.width; i++) {
+                            frame.image->setPixel(target.x + i, target.y + j, pixels[(size_t) j * target.width + i]);
+                        }
+                    }
+                    if (--frame.remaining == 0) {
+                        completed.emplace(std::move(*frame.image));
+                        completedFrame = target.frame;
+                        frame.image.reset();
+                    }
+                    // The last tile is done: stop accepting workers
+                    if (remainingTiles == 0)
+                        listener.shutdown();
+                }
+                holding = false;
+            }
+            changed.notify_all();
+            if (completed)
+                writeFrame(completedFrame, *completed);
+            continue;
+        }
+
+        if (command != "NEXT")
+            break;
+
+        const std::optional<size_t> next = takeTile();
+        if (!next) {
+            worker.writeLine("DONE");
+            return;
+        }
+        holding = true;
+        held = *next;
+        const Tile &tile = tiles[held];
+        if (!worker.writeLine("TILE " + std::to_string(tile.frame) + " " + std::to_string(tile.x) + " " +
+                              std::to_string(tile.y) + " " + std::to_string(tile.width) + " " +
+                              std::to_string(tile.height)))
+            break;
+    }
+
+    // The worker left without returning its tile: let another one take it
+    if (holding) {
+        std::lock_guard<std::mutex> lock(mutex);
+        tiles[held].copies--;
+    }
+    changed.notify_all();
+}
+
+void RenderCoordinator::writeFrame(const int frame, const Image &image)
+{
+    std::vector<char> path(framePattern.size() + 32);
+    std::snprintf(path.data(), path.size(), framePattern.c_str(), frame);
+    writer.submit(image.downsample(settings.getAntiAliasingFactor(), settings.getFilter()), path.data(), tone_mapping);
+    std::cout << "Frame " << frame << " assembled." << std::endl;
+}
+
+bool RenderWorker::run(const std::string &address)
+{
+    Socket coordinator = Socket::connect(address);
+    if (!coordinator.isValid() || !coordinator.writeLine("HELLO"))
+        return false;
+
+    const std::optional<std::string> job = coordinator.readLine();
+    std::istringstream words(job.value_or(""));
+    std::string command;
+    int width = 0, height = 0, SSAA = 0;
+    glm::vec3 position, forward, up;
+    float fov = 0;
+    DOFParams lens{};
+    words >> command >> width >> height >> SSAA >> position.x >> position.y >> position.z >> forward.x >> forward.y >>
+        forward.z >> up.x >> up.y >> up.z >> fov >> lens.samples >> lens.focalLength >> lens.aperture;
+    if (!words || command != "JOB") {
+        std::cerr << "Unexpected job from " << address << ": " << job.value_or("connection closed") << std::endl;
+        return false;
+    }
+    Camera camera(fov, lens);
+    camera.setPosition(position).lookAt(position + forward, up);
+
+    std::optional<int> currentFrame;
+    std::vector<glm::vec3> pixels;
+    int rendered = 0;
+    while (coordinator.writeLine("NEXT")) {
+        const std::optional<std::string> line = coordinator.readLine();
+        if (!line)
+            break;
+        if (*line == "DONE") {
+            std::cout << "Rendered " << rendered << " tiles for " << address << "." << std::endl;
+            return true;
+        }
+
+        std::istringstream tile(*line);
+        int frame = 0, x = 0, y = 0, tileWidth = 0, tileHeight = 0;
+        tile >> command >> frame >> x >> y >> tileWidth >> tileHeight;
+        if (!tile || command != "TILE")
+            break;
+
+        if (update && currentFrame != frame) {
+            update(scene, frame);
+            scene.rebuild();
+        }
+        currentFrame = frame;
+
+        TRACE_SCOPE("worker_tile", rendered);
+        pixels.resize((size_t) tileWidth * tileHeight);
+        #pragma omp parallel for schedule(dynamic, 1) num_threads(omp_get_max_threads())
+        for (int j = 0; j < tileHeight; j++) {
+            for (int i = 0; i < tileWidth; i++) {
+                pixels[(size_t) j * tileWidth + i] =
+                    Raytracer::renderPixel(scene, camera, x + i, y + j, width, height, nullptr);
+            }
+        }
+
+        const std::string header = "PIXELS " + std::to_string(frame) + " " + std::to_string(x) + " " +
+                                   std::to_string(y) + " " + std::to_string(tileWidth) + " " +
+                                   std::to_string(tileHeight);
+        if (!coordinator.writeLine(header) || !coordinator.writeAll(pixels.data(), pixels.size() * sizeof(glm::vec3)))
+            break;
+        rendered++;
+    }
+
+    std::cerr << "Lost the connection to " << address << std::endl;
+    return false;
+}
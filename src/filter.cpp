@@ -0,0 +1,54 @@
+//
+// Created by michele on 19.10.26.
+//
+
+#include "filter.h"
+#include <cmath>
+
+float getFilterRadius(const Filter filter)
+{
+    switch (filter) {
+    case Filter::BOX: return 0.5f;
+    case Filter::TENT: return 1.0f;
+    case Filter::MITCHELL: return 2.0f;
+    case Filter::BLACKMAN_HARRIS: return 2.0f;
+    default: return 0.5f;
+    }
+}
+
+float evaluateFilter(const Filter filter, const float x)
+{
+    const float t = std::fabs(x);
+    const float radius = getFilterRadius(filter);
+    if (t >= radius)
+        return 0.0f;
+
+    switch (filter) {
+    case Filter::BOX: return 1.0f;
+    case Filter::TENT: return 1.0f - t;
+    case Filter::MITCHELL: {
+        constexpr float B = 1.0f / 3.0f;
+        constexpr float C = 1.0f / 3.0f;
+        if (t < 1.0f)
+            return ((12 - 9 * B - 6 * C) * t * t * t + (-18 + 12 * B + 6 * C) * t * t + (6 - 2 * B)) / 6.0f;
+        return ((-B - 6 * C) * t * t * t + (6 * B + 30 * C) * t * t + (-12 * B - 48 * C) * t + (8 * B + 24 * C)) / 6.0f;
+    }
+    case Filter::BLACKMAN_HARRIS: {
+        const float phase = 2.0f * (float) M_PI * (0.5f + 0.5f * x / radius);
+        return 0.35875f - 0.48829f * std::cos(phase) + 0.14128f * std::cos(2.0f * phase) -
+               0.01168f * std::cos(3.0f * phase);
+    }
+    default: return 1.0f;
+    }
+}
+
+const char *getFilterName(const Filter filter)
+{
+    switch (filter) {
+    case Filter::BOX: return "box";
+    case Filter::TENT: return "tent";
+    case Filter::MITCHELL: return "mitchell";
+    case Filter::BLACKMAN_HARRIS: return "blackman-harris";
+    default: return "unknown";
+    }
+}
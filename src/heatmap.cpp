@@ -0,0 +1,93 @@
+//
+// Created by michele on 19.10.26.
+//
+
+#include "heatmap.h"
+#include "image.h"
+#include <algorithm>
+#include <iostream>
+
+CostHeatmap::CostHeatmap(const int width, const int height)
+    : width(width), height(height)
+{
+    for (auto &channel : channels) {
+        channel.resize((size_t) width * height);
+    }
+}
+
+const char *CostHeatmap::getSuffix(const Channel channel)
+{
+    switch (channel) {
+    case NODE_VISITS: return "nodes";
+    case PRIMITIVE_TESTS: return "primitives";
+    case SHADOW_RAYS: return "shadows";
+    case RAY_DEPTH: return "depth";
+    default: return "unknown";
+    }
+}
+
+glm::vec3 CostHeatmap::falseColor(const float t)
+{
+    static const std::array<glm::vec3, 5> ramp = {
+        glm::vec3(0, 0, 0), glm::vec3(0, 0, 1), glm::vec3(1, 0, 0), glm::vec3(1, 1, 0), glm::vec3(1, 1, 1)};
+
+    const float position = glm::clamp(t, 0.0f, 1.0f) * (float) (ramp.size() - 1);
+    const int index = std::min((int) position, (int) ramp.size() - 2);
+    const float fraction = position - (float) index;
+    return ramp[index] * (1.0f - fraction) + ramp[index + 1] * fraction;
+}
+
+void CostHeatmap::record(const int x, const int y, const Stats::ThreadSlot &before, const Stats::ThreadSlot &after)
+{
+    const size_t index = (size_t) y * width + x;
+    const auto delta = [&before, &after](const Counter counter)
+    {
+        return (uint32_t) (after.counters[(size_t) counter] - before.counters[(size_t) counter]);
+    };
+    channels[NODE_VISITS][index] = delta(Counter::NODE_VISITS);
+    channels[PRIMITIVE_TESTS][index] = delta(Counter::PRIMITIVE_TESTS);
+    channels[SHADOW_RAYS][index] = delta(Counter::SHADOW_RAYS);
+    channels[RAY_DEPTH][index] = (uint32_t) after.maxDepth;
+}
+
+void CostHeatmap::write(const std::string &imagePath, const int factor) const
+{
+    // Only a dot in the file name starts the extension, not one in a directory such as ./frames/out
+    const size_t slash = imagePath.find_last_of('/');
+    size_t extension = imagePath.find_last_of('.');
+    if (extension != std::string::npos && slash != std::string::npos && extension < slash)
+        extension = std::string::npos;
+    const std::string stem = imagePath.substr(0, extension);
+    const std::string suffix = extension == std::string::npos ? ".ppm" : imagePath.substr(extension);
+
+    const int outWidth = width / factor;
+    const int outHeight = height / factor;
+
+    for (int c = 0; c < NUM_CHANNELS; c++) {
+        std::vector<uint32_t> reduced((size_t) outWidth * outHeight);
+        for (int j = 0; j < outHeight; j++) {
+            for (int i = 0; i < outWidth; i++) {
+                uint32_t value = 0;
+                for (int l = 0; l < factor; l++) {
+                    for (int k = 0; k < factor; k++) {
+                        const uint32_t v = channels[c][(size_t) (j * factor + l) * width + i * factor + k];
+                        value = c == RAY_DEPTH ? std::max(value, v) : value + v;
+                    }
+                }
+                reduced[(size_t) j * outWidth + i] = value;
+            }
+        }
+
+        const uint32_t maxValue = std::max(1u, *std::max_element(reduced.begin(), reduced.end()));
+        Image image(outWidth, outHeight);
+        for (int j = 0; j < outHeight; j++) {
+            for (int i = 0; i < outWidth; i++) {
+                image.setPixel(i, j, falseColor((float) reduced[(size_t) j * outWidth + i] / (float) maxValue));
+            }
+        }
+
+        const std::string path = stem + "." + getSuffix((Channel) c) + suffix;
+        image.writeImage(path);
+        std::cout << "Heatmap " << path << ": white = " << maxValue << " " << getSuffix((Channel) c) << std::endl;
+    }
+}
@@ -1,60 +1,194 @@
 #include "image.h"
 #include "glm/glm.hpp"
+#include "trace.h"
+#include "writers/writer.h"
+#include <algorithm>
+#include <cmath>
 #include <iostream>
 Image::Image(const int width, const int height)
-    : width(width), height(height), data(width, std::vector<glm::vec3>(height))
+    : width(width), height(height), data((size_t) width * height), weights((size_t) width * height)
 {
 }
-void Image::writeImage(const std::string &path) const
+void Image::writeImage(const std::string &path, const ToneMapping toneMapping) const
 {
-    std::ofstream file(path);
-    file << "P3" << std::endl;
-    file << width << " " << height << std::endl;
-    file << 255 << std::endl;
-    for (int h = 0; h < height; h++) {
-        for (int w = 0; w < width; w++) {
-            file << (int) data[w][h].r << " " << (int) data[w][h].g << " " << (int) data[w][h].b << " ";
-        }
-        file << std::endl;
-    }
-    file.close();
+    ImageWriter::create(path, toneMapping)->write(*this, path);
 }
 
 void Image::setPixel(const int x, const int y, const int r, const int g, const int b)
 {
-    data[x][y] = glm::vec3(r, g, b);
+    setPixel(x, y, glm::vec3(r, g, b) / 255.0f);
 }
 
 void Image::setPixel(const int x, const int y, const float r, const float g, const float b)
 {
-    setPixel(x, y, (int) (255 * r), (int) (255 * g), (int) (255 * b));
+    setPixel(x, y, glm::vec3(r, g, b));
 }
 
 void Image::setPixel(const int x, const int y, const glm::vec3 color)
 {
-    setPixel(x, y, (int) (255 * color.r), (int) (255 * color.g), (int) (255 * color.b));
+    data[index(x, y)] = color;
+    weights[index(x, y)] = 1.0f;
 }
 
-Image Image::downsample(int factor) const
+void Image::addSample(const int x, const int y, const glm::vec3 color, const float weight)
 {
-    if (factor == 1)
-        return *this;
+    data[index(x, y)] += weight * color;
+    weights[index(x, y)] += weight;
+}
+
+glm::vec3 Image::getPixel(const int x, const int y) const
+{
+    const float weight = weights[index(x, y)];
+    return weight > 0 ? data[index(x, y)] / weight : glm::vec3(0);
+}
+
+float Image::getWeight(const int x, const int y) const
+{
+    return weights[index(x, y)];
+}
+
+glm::vec3 Image::getSum(const int x, const int y) const
+{
+    return data[index(x, y)];
+}
+
+void Image::setAccumulated(const int x, const int y, const glm::vec3 sum, const float weight)
+{
+    data[index(x, y)] = sum;
+    weights[index(x, y)] = weight;
+}
+
+void Image::resolveRows(const int y, const int count, glm::vec3 *out) const
+{
+    const size_t begin = index(0, y);
+    const size_t size = (size_t) count * width;
+    for (size_t i = 0; i < size; i++) {
+        const float weight = weights[begin + i];
+        out[i] = weight > 0 ? data[begin + i] / weight : glm::vec3(0);
+    }
+}
+
+namespace {
+
+/**
+ Weights of the source pixels contributing to each destination pixel along one axis.
+ */
+struct Kernel {
+    std::vector<int> first;    ///< index of the first source pixel of each destination pixel
+    std::vector<float> weights;///< taps normalised weights per destination pixel, zero past the image border
+    int taps = 0;
+};
+
+Kernel computeKernel(const int sourceSize, const int targetSize, const Filter filter)
+{
+    const float scale = (float) sourceSize / (float) targetSize;
+    // When shrinking the filter covers a destination pixel, when enlarging it still spans at least a source pixel
+    const float support = std::max(scale, 1.0f);
+    const float radius = getFilterRadius(filter) * support;
+
+    Kernel kernel;
+    kernel.taps = (int) std::ceil(2.0f * radius) + 1;
+    kernel.first.resize(targetSize);
+    kernel.weights.assign((size_t) targetSize * kernel.taps, 0.0f);
 
-    Image downsampled(width / factor, height / factor);
+    for (int i = 0; i < targetSize; i++) {
+        const float centre = ((float) i + 0.5f) * scale;
+        const int first = (int) std::floor(centre - radius);
+        kernel.first[i] = std::max(first, 0);
 
-    for (int i = 0; i < downsampled.width; i++) {
-        for (int j = 0; j < downsampled.height; j++) {
+        float *weights = &kernel.weights[(size_t) i * kernel.taps];
+        float sum = 0.0f;
+        for (int k = 0; k < kernel.taps; k++) {
+            const int source = first + k;
+            if (source < 0 || source >= sourceSize)
+                continue;
+            const float weight = evaluateFilter(filter, ((float) source + 0.5f - centre) / support);
+            weights[source - kernel.first[i]] = weight;
+            sum += weight;
+        }
+
+        if (sum > 0) {
+            for (int k = 0; k < kernel.taps; k++) {
+                weights[k] /= sum;
+            }
+        } else {
+            // Only possible when enlarging with a filter narrower than a source pixel: take the nearest one
+            kernel.first[i] = std::min((int) centre, sourceSize - 1);
+            weights[0] = 1.0f;
+        }
+    }
+
+    return kernel;
+}
+
+}// namespace
+
+Image Image::resize(const int newWidth, const int newHeight, const Filter filter) const
+{
+    TRACE_SCOPE("resize");
+
+    static_assert(sizeof(glm::vec3) == 3 * sizeof(float), "pixels are processed as packed floats");
+
+    const Kernel horizontal = computeKernel(width, newWidth, filter);
+    const Kernel vertical = computeKernel(height, newHeight, filter);
+
+    std::vector<glm::vec3> resolved((size_t) width * height);
+#pragma omp parallel for schedule(static)
+    for (int j = 0; j < height; j++) {
+        resolveRows(j, 1, &resolved[index(0, j)]);
+    }
+
+    // Filter along the rows: width x height -> newWidth x height
+    std::vector<glm::vec3> rows((size_t) newWidth * height);
+#pragma omp parallel for schedule(static)
+    for (int j = 0; j < height; j++) {
+        const glm::vec3 *source = &resolved[index(0, j)];
+        glm::vec3 *target = &rows[(size_t) j * newWidth];
+        for (int i = 0; i < newWidth; i++) {
+            const glm::vec3 *pixels = source + horizontal.first[i];
+            const float *weights = &horizontal.weights[(size_t) i * horizontal.taps];
+            const int taps = std::min(horizontal.taps, width - horizontal.first[i]);
             glm::vec3 color(0);
-            for (int k = 0; k < factor; k++) {
-                for (int l = 0; l < factor; l++) {
-                    color += data[i * factor + k][j * factor + l]; // data contains colors 0-255
-                }
+            for (int k = 0; k < taps; k++) {
+                color += weights[k] * pixels[k];
             }
-            color /= (float) (255 * factor * factor);
-            downsampled.setPixel(i, j, color);
+            target[i] = color;
+        }
+    }
 
+    // Filter along the columns, accumulating whole rows at a time so that the inner loop runs over contiguous floats
+    Image resized(newWidth, newHeight);
+    const int rowFloats = 3 * newWidth;
+#pragma omp parallel for schedule(static)
+    for (int j = 0; j < newHeight; j++) {
+        float *target = &resized.data[resized.index(0, j)].x;
+        const float *weights = &vertical.weights[(size_t) j * vertical.taps];
+        const int taps = std::min(vertical.taps, height - vertical.first[j]);
+        for (int k = 0; k < taps; k++) {
+            const float weight = weights[k];
+            if (weight == 0.0f)
+                continue;
+            const float *source = &rows[(size_t) (vertical.first[j] + k) * newWidth].x;
+            for (int f = 0; f < rowFloats; f++) {
+                target[f] += weight * source[f];
+            }
+        }
+        // Filters with negative lobes can overshoot below zero next to bright edges
+        for (int f = 0; f < rowFloats; f++) {
+            target[f] = std::max(target[f], 0.0f);
         }
+        std::fill_n(&resized.weights[resized.index(0, j)], newWidth, 1.0f);
     }
 
-    return downsampled;
+    return resized;
+}
+
+Image Image::downsample(const int factor, const Filter filter) const
+{
+    if (factor == 1)
+        return *this;
+
+    TRACE_SCOPE("downsample");
+
+    return resize(width / factor, height / factor, filter);
 }
@@ -5,57 +5,237 @@
 #include "lightning.h"
 #include "ray.h"
 #include "scene.h"
+#include "stats.h"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
 
-float shadow(const Scene &scene, const glm::vec3 &point, const std::shared_ptr<Light> &light)
+namespace
 {
-    int rays = 0;
-    int blocked = 0;
-    for (const glm::vec3 &sample : light->getSamples()) {
-        const glm::vec3 light_direction = glm::normalize(sample - point);
-        const Ray shadow_ray = Ray(point, light_direction);
-        const std::optional<Hit> shadow_hit = scene.intersect(shadow_ray);
-        if (shadow_hit && glm::distance(shadow_hit->intersection, point) < glm::distance(sample, point)
-            && shadow_hit->object != light->getLightObject().get())
+
+uint32_t float_bits(const float value)
+{
+    uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+/**
+ Samples of a light in structure-of-arrays layout, with the factors by which each one scales the diffuse and the
+ specular coefficients, so that the shading of consecutive samples maps onto SIMD lanes
+ */
+struct SampleBlock {
+    std::vector<float> x, y, z, weight;
+    std::vector<float> diffuse, specular;
+
+    void load(const std::vector<LightSample> &samples)
+    {
+        const size_t count = samples.size();
+        x.resize(count);
+        y.resize(count);
+        z.resize(count);
+        weight.resize(count);
+        diffuse.resize(count);
+        specular.resize(count);
+        for (size_t s = 0; s < count; s++) {
+            x[s] = samples[s].position.x;
+            y[s] = samples[s].position.y;
+            z[s] = samples[s].position.z;
+            weight[s] = samples[s].weight;
+        }
+    }
+};
+
+/**
+ Fill the diffuse and specular factors of every sample, attenuated and weighted: phong_brdf, without branches and
+ without building the direction of each sample nor its reflection
+ */
+void shade_samples(SampleBlock &block, const glm::vec3 &point, const glm::vec3 &normal,
+                   const glm::vec3 &view_direction, const float shininess)
+{
+    const size_t count = block.x.size();
+    const float *x = block.x.data();
+    const float *y = block.y.data();
+    const float *z = block.z.data();
+    const float *weight = block.weight.data();
+    float *diffuse = block.diffuse.data();
+    float *specular = block.specular.data();
+    const float normal_view = glm::dot(normal, view_direction);
+
+    #pragma omp simd
+    for (size_t s = 0; s < count; s++) {
+        const float dx = x[s] - point.x;
+        const float dy = y[s] - point.y;
+        const float dz = z[s] - point.z;
+        const float length = std::sqrt(dx * dx + dy * dy + dz * dz);
+        const float light_angle = (dx * normal.x + dy * normal.y + dz * normal.z) / length;
+        const float light_view = (dx * view_direction.x + dy * view_direction.y + dz * view_direction.z) / length;
+        // dot(reflect(-light_direction, normal), view_direction)
+        const float reflection_angle = 2.0f * light_angle * normal_view - light_view;
+        const float distance = std::max(0.1f, length);
+        const float attenuation = weight[s] / (distance * distance);
+        // Nothing from below the surface, not even a highlight
+        const float lit = light_angle > 0 ? attenuation : 0.0f;
+        const float highlight = std::pow(std::max(reflection_angle, 0.0f), shininess);
+        diffuse[s] = lit * light_angle;
+        specular[s] = reflection_angle > 0 ? lit * highlight : 0.0f;
+    }
+}
+
+}// namespace
+
+bool is_occluded(const Scene &scene, const glm::vec3 &point, const glm::vec3 &sample, const Light &light)
+{
+    const glm::vec3 light_direction = glm::normalize(sample - point);
+    const Ray shadow_ray = Ray(point, light_direction);
+    Stats::increment(Counter::SHADOW_RAYS);
+    const std::optional<Hit> shadow_hit = scene.intersect(shadow_ray);
+    const float distance = glm::distance(sample, point);
+    if (!shadow_hit || glm::distance(shadow_hit->intersection, point) >= distance)
+        return false;
+    // The light object only hides its own samples from the other side
+    return shadow_hit->object != light.getLightObject().get()
+        || glm::distance(shadow_hit->intersection, sample) > 1e-3f * distance;
+}
+
+glm::vec3 phong_brdf(const glm::vec3 &normal, const glm::vec3 &light_direction, const glm::vec3 &view_direction,
+                     const glm::vec3 &albedo, const glm::vec3 &specular, const float shininess)
+{
+    const float light_angle = glm::dot(normal, light_direction);
+    if (light_angle <= 0)
+        // Below the surface: no light, not even a highlight
+        return glm::vec3(0);
+
+    const glm::vec3 diffuse = albedo * light_angle;
+
+    glm::vec3 reflection_direction = glm::normalize(glm::reflect(-light_direction, normal));
+    const float reflection_angle = glm::dot(reflection_direction, view_direction);
+    if (reflection_angle <= 0)
+        return diffuse;
+    return diffuse + specular * glm::pow(reflection_angle, shininess);
+}
+
+/**
+ * Light reaching a point from some samples of one light and reflected towards the viewer.
+ * @param seed distinguishes the samples drawn for the point, so that each light and each pick draws its own
+ */
+glm::vec3 direct_light(const Scene &scene, const Light &light, const uint32_t seed, const glm::vec3 &point,
+                       const glm::vec3 &normal, const glm::vec2 &uv, const glm::vec3 &view_direction,
+                       const Material &material)
+{
+    thread_local std::vector<LightSample> samples;
+    thread_local SampleBlock block;
+    thread_local std::vector<glm::vec3> unshadowed;
+
+    const glm::vec3 albedo = material.texture ? material.diffuse * material.texture(uv) : material.diffuse;
+
+    // Seeded by the shaded point, so that each point draws its own samples and every run draws the same ones
+    Sampler sampler(float_bits(point.x), float_bits(point.y), float_bits(point.z) ^ seed);
+    samples.clear();
+    light.sample(point, sampler, samples);
+
+    block.load(samples);
+    shade_samples(block, point, normal, view_direction, material.shininess);
+
+    unshadowed.resize(samples.size());
+    const glm::vec3 color = light.getColor();
+    for (size_t s = 0; s < samples.size(); s++)
+        unshadowed[s] = color * (albedo * block.diffuse[s] + material.specular * block.specular[s]);
+
+    // The first samples already cover the light: when they agree, the point is taken as fully lit or fully in
+    // shadow, and only in the penumbra are the others tested. Samples contributing nothing are not tested. Each group
+    // is traced as one batch of rays from the point.
+    thread_local ShadowBatch batch;
+    thread_local std::vector<size_t> tested;
+    thread_local std::vector<bool> occluded;
+    batch.origin = point;
+    batch.light = light.getLightObject().get();
+
+    const size_t probes = std::min(samples.size(), (size_t) SHADOW_PROBES);
+    batch.targets.clear();
+    tested.clear();
+    for (size_t s = 0; s < probes; s++) {
+        if (unshadowed[s] == glm::vec3(0))
+            continue;
+        batch.targets.push_back(samples[s].position);
+        tested.push_back(s);
+    }
+    if (!tested.empty())
+        scene.traceShadows(batch, occluded);
+
+    size_t blocked = 0;
+    glm::vec3 lit(0);
+    for (size_t t = 0; t < tested.size(); t++) {
+        if (occluded[t])
             blocked++;
-        rays++;
+        else
+            lit += unshadowed[tested[t]];
     }
-    return 1.0f - ((float) blocked * 1.0f) / (float) rays;
+
+    const bool umbra = !tested.empty() && blocked == tested.size();
+    const bool unoccluded = !tested.empty() && blocked == 0;
+    if (umbra)
+        return lit;
+
+    batch.targets.clear();
+    tested.clear();
+    for (size_t s = probes; s < samples.size(); s++) {
+        if (unshadowed[s] == glm::vec3(0))
+            continue;
+        if (unoccluded) {
+            lit += unshadowed[s];
+            continue;
+        }
+        batch.targets.push_back(samples[s].position);
+        tested.push_back(s);
+    }
+    if (!tested.empty()) {
+        scene.traceShadows(batch, occluded);
+        for (size_t t = 0; t < tested.size(); t++) {
+            if (!occluded[t])
+                lit += unshadowed[tested[t]];
+        }
+    }
+    return lit;
 }
 
 glm::vec3 phong_model(const Scene &scene, const glm::vec3 &point, const glm::vec3 &normal, const glm::vec2 &uv, const glm::vec3 &view_direction, const Material &material)
 {
     glm::vec3 color = material.ambient * scene.getAmbientLight();// diffusion
-    for (const auto &light : scene.getLights()) {
-        glm::vec3 plc(0.0f);
-        for (const auto &light_position : light->getSamples()) {
-            const glm::vec3 light_direction = glm::normalize(light_position - point);
-            glm::vec3 diffuse(0);
-            const float light_angle = glm::dot(normal, light_direction);
-            if (light_angle > 0) {
-                diffuse = material.diffuse * light_angle * light->getColor();
-                if (material.texture)
-                    diffuse *= material.texture(uv);
-            }
 
-            glm::vec3 reflection_direction = glm::normalize(glm::reflect(-light_direction, normal));
-            glm::vec3 specular(0);
-            const float reflection_angle = glm::dot(reflection_direction, view_direction);
-            if (reflection_angle > 0) {
-                specular = material.specular * glm::pow(reflection_angle, material.shininess) * light->getColor();
+    const auto &lights = scene.getLights();
+    const LightGrid *grid = scene.getLightGrid();
+    if (grid) {
+        // Only the lights in range, found before any shading or shadow ray
+        const std::vector<int> &nearby = grid->query(point);
+        if (nearby.size() <= LIGHT_TREE_THRESHOLD) {
+            for (const int l : nearby) {
+                if (grid->reaches(l, point))
+                    color += direct_light(scene, *lights[l], (uint32_t) l * 0x9e3779b9U, point, normal, uv,
+                                          view_direction, material);
             }
-
-            plc += (diffuse + specular);
+            return color;
         }
+    } else if (lights.size() <= LIGHT_TREE_THRESHOLD) {
+        for (size_t l = 0; l < lights.size(); l++) {
+            color += direct_light(scene, *lights[l], (uint32_t) l * 0x9e3779b9U, point, normal, uv, view_direction,
+                                  material);
+        }
+        return color;
+    }
 
-        const auto closest_sample = *std::min_element(light->getSamples().begin(), light->getSamples().end(),
-                                                     [point](const glm::vec3 &a, const glm::vec3 &b) {
-                                                         return glm::distance(a, point) < glm::distance(b, point);
-                                                     });
-        const float distance = std::max(0.1f, glm::distance(closest_sample, point));
-        const float attenuation = 1.0f / (distance*distance);
-
-        const float shadow_factor = shadow(scene, point, light);
-        color += (attenuation * shadow_factor * plc) / (float) light->getSamples().size();
+    // Many lights: pick a few by importance, each weighted by the inverse of its probability
+    Sampler sampler(float_bits(point.x), float_bits(point.y), ~float_bits(point.z));
+    for (int pick = 0; pick < LIGHT_TREE_PICKS; pick++) {
+        const std::optional<std::pair<int, float>> picked = scene.getLightTree().pick(point, normal, sampler);
+        if (!picked)
+            break;
+        if (grid && !grid->reaches(picked->first, point))
+            continue;
+        const uint32_t seed = (uint32_t) picked->first * 0x9e3779b9U ^ (uint32_t) pick * 0x85ebca6bU;
+        color += direct_light(scene, *lights[picked->first], seed, point, normal, uv, view_direction, material)
+            / (picked->second * (float) LIGHT_TREE_PICKS);
     }
     return color;
 }
@@ -88,69 +268,176 @@ bool is_total_internal_reflection(const glm::vec3 &normal, const glm::vec3 &view
     return sin_theta_t_2 > 1;
 }
 
+glm::vec2 specular_factors(const glm::vec3 &normal, const glm::vec3 &view_direction, const Material &material,
+                           const bool inside_object)
+{
+    const float n1 = inside_object ? material.refractive_index : 1.0f;
+    const float n2 = inside_object ? 1.0f : material.refractive_index;
+
+    float reflection_factor = material.reflection;
+    float refraction_factor = material.transparency;
+    if (refraction_factor <= 0)
+        return {reflection_factor, 0.0f};
+    if (is_total_internal_reflection(normal, view_direction, n1, n2))
+        return {1.0f, 0.0f};
+
+    const float fresnel_factor = fresnel(normal, view_direction, n1, n2);
+    if (reflection_factor > 0)
+        reflection_factor *= fresnel_factor;
+    else
+        reflection_factor = fresnel_factor;
+    refraction_factor *= 1.0f - fresnel_factor;
+    return {reflection_factor, refraction_factor};
+}
+
+namespace
+{
+
 /**
- Functions that computes a color along the ray
- @param ray Ray that should be traced through the scene
- @return Color at the intersection point
+ Secondary ray waiting to be traced, with the fraction of the light of the pixel it carries
+ */
+struct PendingRay {
+    glm::vec3 origin;
+    glm::vec3 direction;
+    float weight;
+    int depth;
+    Counter counter;
+};
+
+/**
+ Fixed-size stack of the pending rays of one pixel, sorted by weight so that the heaviest is traced first. When full,
+ the lightest ray is the one dropped.
  */
-glm::vec3 trace_ray(const Scene &scene, const Ray &ray, int depth, float refl_cumulative, float refr_cumulative)
+class RayStack
 {
+private:
+    std::array<PendingRay, RAY_STACK_SIZE> entries{};
+    size_t count = 0;
+
+public:
+    [[nodiscard]] bool empty() const { return count == 0; }
+
+    void push(const PendingRay &ray)
+    {
+        if (count == entries.size()) {
+            if (ray.weight <= entries[0].weight)
+                return;
+            std::move(entries.begin() + 1, entries.end(), entries.begin());
+            count--;
+        }
+        size_t slot = count++;
+        for (; slot > 0 && entries[slot - 1].weight > ray.weight; slot--)
+            entries[slot] = entries[slot - 1];
+        entries[slot] = ray;
+    }
+
+    PendingRay pop() { return entries[--count]; }
+};
+
+/**
+ Push a secondary ray, unless it carries no light or is too deep. A ray carrying less than ROULETTE_WEIGHT survives
+ with probability weight / ROULETTE_WEIGHT and then carries ROULETTE_WEIGHT, the same light on average.
+ */
+void push_ray(RayStack &stack, Sampler &sampler, PendingRay ray)
+{
+    if (ray.weight <= 0 || ray.depth > MAX_RAY_DEPTH)
+        return;
+    if (ray.weight < ROULETTE_WEIGHT) {
+        if (sampler.next() * ROULETTE_WEIGHT >= ray.weight)
+            return;
+        ray.weight = ROULETTE_WEIGHT;
+    }
+    stack.push(ray);
+}
+
+/**
+ Push the reflected and refracted rays of a hit of a ray carrying the given weight
+ */
+void push_secondary(RayStack &stack, const Ray &ray, const Hit &hit, const Material &material, const float weight,
+                    const int depth)
+{
+    const bool inside_object = glm::dot(ray.direction, hit.normal) > 0;
+    const glm::vec3 normal = inside_object ? -hit.normal : hit.normal;
+
+    const float n1 = inside_object ? material.refractive_index : 1.0f;
+    const float n2 = inside_object ? 1.0f : material.refractive_index;
+
+    const glm::vec2 factors = specular_factors(normal, -ray.direction, material, inside_object);
+    const float reflection_factor = factors.x;
+    const float refraction_factor = factors.y;
+    if (reflection_factor <= 0 && refraction_factor <= 0)
+        return;
+
+    // Seeded by the hit, like the light samples, so that every run draws the same
+    Sampler sampler(float_bits(hit.intersection.x), float_bits(hit.intersection.y),
+                    float_bits(hit.intersection.z) ^ (uint32_t) depth);
+    push_ray(stack, sampler, {hit.intersection, glm::reflect(ray.direction, normal), weight * reflection_factor,
+                              depth + 1, Counter::REFLECTION_RAYS});
+    if (refraction_factor > 0)
+        push_ray(stack, sampler, {hit.intersection, glm::refract(ray.direction, normal, n1 / n2),
+                                  weight * refraction_factor, depth + 1, Counter::REFRACTION_RAYS});
+}
+
+/**
+ Trace a ray carrying the given weight, pushing its secondary rays
+ @param hit_out if not null, receives the closest hit of the ray
+ @return the weighted local (ambient and direct) light of the hit
+ */
+glm::vec3 shade_ray(const Scene &scene, const Ray &ray, const float weight, const int depth, RayStack &stack,
+                    std::optional<Hit> *hit_out = nullptr)
+{
+    Stats::recordDepth(depth);
     const std::optional<Hit> closest_hit = scene.intersect(ray);
+    if (hit_out)
+        *hit_out = closest_hit;
     if (!closest_hit)
         return {0, 0, 0};
 
     const std::optional<Material> material = closest_hit->object->getSurfaceSafe<Material>();
     if (!material)
-        return closest_hit->object->getSurface<glm::vec3>();
+        return weight * closest_hit->object->getSurface<glm::vec3>();
 
     const bool inside_object = glm::dot(ray.direction, closest_hit->normal) > 0;
     const glm::vec3 normal = inside_object ? -closest_hit->normal : closest_hit->normal;
 
     const glm::vec3 phong = phong_model(scene, closest_hit->intersection, normal, closest_hit->uv, glm::normalize(-ray.direction), *material);
+    push_secondary(stack, ray, *closest_hit, *material, weight, depth);
+    return weight * phong;
+}
 
-    if (depth >= MAX_RAY_DEPTH)
-        return phong;
-
-    const float n1 = inside_object ? material->refractive_index : 1.0f;
-    const float n2 = inside_object ? 1.0f : material->refractive_index;
-
-    // If the reflection/refraction coefficients get too small during the recursion, their contribution is negligible.
-    // This check avoids recursion if the material is not transparent/reflective, but also reduces the recursion in the
-    // case of a transparent/reflective material with a low coefficient.
-    const float COEFFICIENT_THRESH = 1e-4f;
-
-    float reflection_factor = material->reflection;
-    float refraction_factor = material->transparency;
-    if (is_total_internal_reflection(normal, -ray.direction, n1, n2)) {
-        reflection_factor = 1;
-        refraction_factor = 0;
-    }
-    else if (refraction_factor > COEFFICIENT_THRESH) {
-        float fresnel_factor = fresnel(normal, -ray.direction, n1, n2);
-
-        if (reflection_factor > COEFFICIENT_THRESH)
-            reflection_factor *= fresnel_factor;
-        else
-            reflection_factor = fresnel_factor;
-        refraction_factor *= 1.0f - fresnel_factor;
+/**
+ Trace the pending rays, heaviest first, until none is left
+ */
+glm::vec3 trace_pending(const Scene &scene, RayStack &stack)
+{
+    glm::vec3 color(0);
+    while (!stack.empty()) {
+        const PendingRay pending = stack.pop();
+        Stats::increment(pending.counter);
+        color += shade_ray(scene, Ray(pending.origin, pending.direction), pending.weight, pending.depth, stack);
     }
+    return color;
+}
 
-    // reflection
-    const Ray reflection_ray = Ray(closest_hit->intersection, glm::reflect(ray.direction, normal));
-    glm::vec3 reflected_color(0);
-    if (reflection_factor * refl_cumulative > COEFFICIENT_THRESH)
-        reflected_color = trace_ray(scene, reflection_ray, depth + 1, reflection_factor * refl_cumulative, refr_cumulative);
+}// namespace
 
-    // refraction
-    const float n = n1 / n2;
-    const glm::vec3 refracted_direction = glm::refract(ray.direction, normal, n);
-    const Ray refraction_ray = Ray(closest_hit->intersection, refracted_direction);
-
-    glm::vec3 refracted_color(0);
-    if (refraction_factor * refr_cumulative > COEFFICIENT_THRESH)
-        refracted_color = trace_ray(scene, refraction_ray, depth + 1, refl_cumulative, refraction_factor * refr_cumulative);
+/**
+ Functions that computes a color along the ray
+ @param ray Ray that should be traced through the scene
+ @return Color at the intersection point
+ */
+glm::vec3 trace_ray(const Scene &scene, const Ray &ray, std::optional<Hit> *primary_hit)
+{
+    RayStack stack;
+    const glm::vec3 color = shade_ray(scene, ray, 1.0f, 0, stack, primary_hit);
+    return color + trace_pending(scene, stack);
+}
 
-    return phong + reflection_factor * reflected_color + refraction_factor * refracted_color;
+glm::vec3 trace_secondary(const Scene &scene, const Ray &ray, const Hit &hit, const Material &material)
+{
+    RayStack stack;
+    push_secondary(stack, ray, hit, material, 1.0f, 0);
+    return trace_pending(scene, stack);
 }
 
 /**
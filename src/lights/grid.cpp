@@ -0,0 +1,84 @@
+//
+// Created by michele on 19.10.26.
+//
+
+#include "lights/grid.h"
+#include <algorithm>
+#include <cmath>
+
+LightGrid::LightGrid(const std::vector<std::shared_ptr<Light>> &lights, const float threshold)
+{
+    if (lights.empty())
+        return;
+
+    influences.reserve(lights.size());
+    for (const auto &light : lights) {
+        const glm::vec3 color = light->getColor();
+        const float intensity = std::max(std::max(color.r, color.g), color.b);
+        influences.push_back({light->getBounds(), std::sqrt(intensity / threshold)});
+    }
+
+    bounds = Box(influences[0].bounds.min - influences[0].radius, influences[0].bounds.max + influences[0].radius);
+    for (const Influence &influence : influences) {
+        bounds.merge(Box(influence.bounds.min - influence.radius, influence.bounds.max + influence.radius));
+    }
+
+    // Cubic cells, as many as CELLS_PER_LIGHT per light
+    const glm::vec3 extent = glm::max(bounds.max - bounds.min, glm::vec3(1e-4f));
+    const float volume = extent.x * extent.y * extent.z;
+    const float side = std::cbrt(volume / (float) (CELLS_PER_LIGHT * lights.size()));
+    for (int axis = 0; axis < 3; axis++) {
+        resolution[axis] = std::clamp((int) std::ceil(extent[axis] / side), 1, MAX_RESOLUTION);
+        cellSize[axis] = extent[axis] / (float) resolution[axis];
+    }
+    cells.resize((size_t) resolution[0] * resolution[1] * resolution[2]);
+
+    for (size_t l = 0; l < influences.size(); l++) {
+        const Influence &influence = influences[l];
+        std::array<int, 3> first{}, last{};
+        for (int axis = 0; axis < 3; axis++) {
+            const float from = (influence.bounds.min[axis] - influence.radius - bounds.min[axis]) / cellSize[axis];
+            const float to = (influence.bounds.max[axis] + influence.radius - bounds.min[axis]) / cellSize[axis];
+            first[axis] = std::clamp((int) std::floor(from), 0, resolution[axis] - 1);
+            last[axis] = std::clamp((int) std::floor(to), 0, resolution[axis] - 1);
+        }
+
+        for (int z = first[2]; z <= last[2]; z++) {
+            for (int y = first[1]; y <= last[1]; y++) {
+                for (int x = first[0]; x <= last[0]; x++) {
+                    const glm::vec3 cellMin = bounds.min + glm::vec3((float) x, (float) y, (float) z) * cellSize;
+                    if (distance(Box(cellMin, cellMin + cellSize), influence.bounds) <= influence.radius)
+                        cells[((size_t) z * resolution[1] + y) * resolution[0] + x].push_back((int) l);
+                }
+            }
+        }
+    }
+}
+
+float LightGrid::distance(const Box &a, const Box &b)
+{
+    const glm::vec3 gap = glm::max(glm::max(a.min - b.max, b.min - a.max), glm::vec3(0));
+    return glm::length(gap);
+}
+
+const std::vector<int> &LightGrid::query(const glm::vec3 &point) const
+{
+    static const std::vector<int> NONE;
+    if (cells.empty())
+        return NONE;
+
+    std::array<int, 3> cell{};
+    for (int axis = 0; axis < 3; axis++) {
+        const float position = (point[axis] - bounds.min[axis]) / cellSize[axis];
+        if (position < 0 || position >= (float) resolution[axis] + 1e-3f)
+            return NONE;
+        cell[axis] = std::min((int) position, resolution[axis] - 1);
+    }
+    return cells[((size_t) cell[2] * resolution[1] + cell[1]) * resolution[0] + cell[0]];
+}
+
+bool LightGrid::reaches(const int light, const glm::vec3 &point) const
+{
+    const Influence &influence = influences[light];
+    return distance(Box(point, point), influence.bounds) <= influence.radius;
+}
@@ -1,5 +1,6 @@
 #include "lights/light.h"
 #include "glm/glm.hpp"
+#include <algorithm>
 #include <utility>
 #include <vector>
 
@@ -20,6 +21,31 @@ const std::vector<glm::vec3> &Light::getSamples() const
 {
     return samples;
 }
+void Light::sample(const glm::vec3 &point __attribute_maybe_unused__, Sampler &sampler __attribute_maybe_unused__,
+                   std::vector<LightSample> &out) const
+{
+    for (const glm::vec3 &sample : samples) {
+        out.push_back({sample, 1.0f / (float) samples.size()});
+    }
+}
+
+LightPoint Light::samplePoint(const glm::vec2 &u) const
+{
+    const int index = std::min((int) (u.x * (float) samples.size()), (int) samples.size() - 1);
+    return {samples[index], glm::vec3(0)};
+}
+
+Box Light::getBounds() const
+{
+    if (samples.empty())
+        return {};
+    Box bounds(samples.front(), samples.front());
+    for (const glm::vec3 &sample : samples) {
+        bounds.merge(Box(sample, sample));
+    }
+    return bounds;
+}
+
 std::shared_ptr<Object> Light::getLightObject() const
 {
     return nullptr;
@@ -3,6 +3,49 @@
 //
 
 #include "lights/surface.h"
+#include <algorithm>
+#include <limits>
+
+namespace
+{
+
+/**
+ * Reorder the samples by farthest point: each is the one farthest from all the previous ones, so that every prefix
+ * covers the surface evenly.
+ */
+std::vector<glm::vec3> stratify(std::vector<glm::vec3> samples)
+{
+    if (samples.size() < 3)
+        return samples;
+
+    glm::vec3 centroid(0);
+    for (const glm::vec3 &sample : samples) {
+        centroid += sample;
+    }
+    centroid /= (float) samples.size();
+
+    // Start from the sample closest to the centre, then repeatedly take the farthest from those already taken
+    std::vector<float> distances(samples.size());
+    for (size_t s = 0; s < samples.size(); s++) {
+        distances[s] = glm::distance(samples[s], centroid);
+    }
+    std::swap(samples[0], samples[std::min_element(distances.begin(), distances.end()) - distances.begin()]);
+    std::fill(distances.begin(), distances.end(), std::numeric_limits<float>::max());
+
+    for (size_t taken = 1; taken < samples.size(); taken++) {
+        size_t farthest = taken;
+        for (size_t s = taken; s < samples.size(); s++) {
+            distances[s] = std::min(distances[s], glm::distance(samples[s], samples[taken - 1]));
+            if (distances[s] > distances[farthest])
+                farthest = s;
+        }
+        std::swap(samples[taken], samples[farthest]);
+        std::swap(distances[taken], distances[farthest]);
+    }
+    return samples;
+}
+
+}// namespace
 
 SurfaceLight::SurfaceLight(const std::shared_ptr<Object> &object)
     : SurfaceLight(glm::vec3(1), object)
@@ -10,9 +53,51 @@ SurfaceLight::SurfaceLight(const std::shared_ptr<Object> &object)
 }
 
 SurfaceLight::SurfaceLight(glm::vec3 color, const std::shared_ptr<Object> &object)
-    : Light(color, object->getSamples(SurfaceLight::SAMPLES)), object(object)
+    : Light(color, stratify(object->getSamples(SurfaceLight::SAMPLES))), object(object)
 {
 }
+void SurfaceLight::sample(const glm::vec3 &point, Sampler &sampler, std::vector<LightSample> &out) const
+{
+    static_assert(GRID % 2 == 0, "the strata are visited one per quadrant");
+    constexpr int HALF = GRID / 2;
+    constexpr int STRATA = GRID * GRID;
+
+    const size_t first = out.size();
+    for (int k = 0; k < STRATA; k++) {
+        // Cycle through the quadrants, so that every prefix of four samples spans the whole surface
+        const int quadrant = k % 4;
+        const int cell = k / 4;
+        const int x = quadrant % 2 * HALF + cell % HALF;
+        const int y = quadrant / 2 * HALF + cell / HALF;
+        const glm::vec2 u = (glm::vec2((float) x, (float) y) + sampler.next2D()) / (float) GRID;
+
+        const std::optional<SurfacePoint> surface = object->sampleSurface(u);
+        if (!surface) {
+            out.resize(first);
+            Light::sample(point, sampler, out);
+            return;
+        }
+
+        // A Lambertian emitter sends less light at grazing angles. Flat emitters shine on both sides, while the far
+        // side of closed ones is hidden by the object itself
+        const glm::vec3 direction = glm::normalize(point - surface->point);
+        out.push_back({surface->point, std::abs(glm::dot(surface->normal, direction)) / (float) STRATA});
+    }
+}
+
+LightPoint SurfaceLight::samplePoint(const glm::vec2 &u) const
+{
+    const std::optional<SurfacePoint> surface = object->sampleSurface(u);
+    if (!surface)
+        return Light::samplePoint(u);
+    return {surface->point, surface->normal};
+}
+
+Box SurfaceLight::getBounds() const
+{
+    return object->getBoundingBox();
+}
+
 std::shared_ptr<Object> SurfaceLight::getLightObject() const
 {
     return object;
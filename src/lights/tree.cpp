@@ -0,0 +1,115 @@
+//
+// Created by michele on 19.10.26.
+//
+
+#include "lights/tree.h"
+#include <algorithm>
+
+LightTree::LightTree(const std::vector<std::shared_ptr<Light>> &lights)
+{
+    if (lights.empty())
+        return;
+
+    std::vector<std::pair<Box, int>> entries;
+    entries.reserve(lights.size());
+    for (size_t l = 0; l < lights.size(); l++) {
+        entries.emplace_back(lights[l]->getBounds(), (int) l);
+    }
+
+    nodes.reserve(2 * lights.size() - 1);
+    nodes.emplace_back();
+    build(entries, 0, entries.size(), lights, 0);
+}
+
+void LightTree::build(std::vector<std::pair<Box, int>> &entries, const size_t begin, const size_t end,
+                      const std::vector<std::shared_ptr<Light>> &lights, const int index)
+{
+    Box bounds = entries[begin].first;
+    Box centroids(bounds.getCenter(), bounds.getCenter());
+    float power = 0;
+    for (size_t e = begin; e < end; e++) {
+        bounds.merge(entries[e].first);
+        centroids.merge(Box(entries[e].first.getCenter(), entries[e].first.getCenter()));
+        const glm::vec3 color = lights[entries[e].second]->getColor();
+        power += (color.r + color.g + color.b) / 3.0f;
+    }
+
+    if (end - begin == 1) {
+        nodes[index] = {bounds, power, -1, entries[begin].second};
+        return;
+    }
+
+    // Split at the median of the centres along the axis over which they spread the most
+    const glm::vec3 extent = centroids.max - centroids.min;
+    const int axis = extent.x > extent.y && extent.x > extent.z ? 0 : (extent.y > extent.z ? 1 : 2);
+    const size_t middle = begin + (end - begin) / 2;
+    std::nth_element(entries.begin() + (long) begin, entries.begin() + (long) middle, entries.begin() + (long) end,
+                     [axis](const std::pair<Box, int> &a, const std::pair<Box, int> &b) {
+                         return a.first.getCenter()[axis] < b.first.getCenter()[axis];
+                     });
+
+    const int child = (int) nodes.size();
+    nodes.resize(nodes.size() + 2);
+    nodes[index] = {bounds, power, child, -1};
+    build(entries, begin, middle, lights, child);
+    build(entries, middle, end, lights, child + 1);
+}
+
+float LightTree::importance(const Node &node, const glm::vec3 &point, const glm::vec3 &normal) const
+{
+    const Box &bounds = node.bounds;
+    const glm::vec3 diagonal = bounds.max - bounds.min;
+    const glm::vec3 centre = bounds.getCenter();
+
+    // Highest cosine between the normal and a corner of the box; nothing rises above the tangent plane if all the
+    // corners are below it
+    float cosine = 0;
+    const bool inside = point.x >= bounds.min.x && point.y >= bounds.min.y && point.z >= bounds.min.z
+        && point.x <= bounds.max.x && point.y <= bounds.max.y && point.z <= bounds.max.z;
+    if (inside) {
+        cosine = 1;
+    } else {
+        for (int corner = 0; corner < 8; corner++) {
+            const glm::vec3 position((corner & 1) ? bounds.max.x : bounds.min.x,
+                                     (corner & 2) ? bounds.max.y : bounds.min.y,
+                                     (corner & 4) ? bounds.max.z : bounds.min.z);
+            const glm::vec3 direction = position - point;
+            const float projection = glm::dot(normal, direction);
+            if (projection > 0)
+                cosine = std::max(cosine, projection / glm::length(direction));
+        }
+        if (cosine <= 0)
+            return 0;
+    }
+
+    // Points within the box would get an unbounded weight: clamp the distance to the half diagonal
+    const float distance2 = std::max(glm::dot(centre - point, centre - point), 0.25f * glm::dot(diagonal, diagonal));
+    return node.power * cosine / std::max(distance2, 1e-8f);
+}
+
+std::optional<std::pair<int, float>> LightTree::pick(const glm::vec3 &point, const glm::vec3 &normal,
+                                                     Sampler &sampler) const
+{
+    if (nodes.empty() || importance(nodes[0], point, normal) <= 0)
+        return std::nullopt;
+
+    int index = 0;
+    float probability = 1;
+    while (nodes[index].child >= 0) {
+        const int child = nodes[index].child;
+        const float left = importance(nodes[child], point, normal);
+        const float right = importance(nodes[child + 1], point, normal);
+        if (left + right <= 0)
+            return std::nullopt;
+
+        const float pickLeft = left / (left + right);
+        if (sampler.next() < pickLeft) {
+            index = child;
+            probability *= pickLeft;
+        } else {
+            index = child + 1;
+            probability *= 1 - pickLeft;
+        }
+    }
+    return std::make_pair(nodes[index].light, probability);
+}
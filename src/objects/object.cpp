@@ -43,3 +43,8 @@ std::vector<glm::vec3> Object::getSamples(int n __attribute_maybe_unused__) cons
 {
     return {};
 }
+
+std::optional<SurfacePoint> Object::sampleSurface(const glm::vec2 &u __attribute_maybe_unused__) const
+{
+    return std::nullopt;
+}
@@ -3,6 +3,7 @@
 //
 
 #include "objects/square.h"
+#include <algorithm>
 
 Square::Square(glm::vec3 p1, glm::vec3 p2, glm::vec3 p3, glm::vec3 p4, const Material &material)
     : Object(material), triangles({Triangle({p1, p2, p3}, material), Triangle({p1, p3, p4}, material)})
@@ -41,6 +42,13 @@ std::vector<glm::vec3> Square::getSamples(int n) const
     samples.insert(samples.end(), t2.begin(), t2.end());
     return samples;
 }
+std::optional<SurfacePoint> Square::sampleSurface(const glm::vec2 &u) const
+{
+    // Both halves have the same area: the first coordinate picks one and is stretched back to [0, 1)
+    const int half = u.x < 0.5f ? 0 : 1;
+    return triangles[half].sampleSurface({std::min(2.0f * u.x - (float) half, 1.0f), u.y});
+}
+
 Box Square::computeBoundingBox()
 {
     return triangles[0].getBoundingBox() + triangles[1].getBoundingBox();
@@ -0,0 +1,146 @@
+//
+// Created by michele on 19.10.26.
+//
+
+#include "pathtracer.h"
+#include "lightning.h"
+#include "stats.h"
+#include <algorithm>
+#include <cmath>
+#include <optional>
+
+namespace
+{
+
+/**
+ Direction distributed with density proportional to its cosine with the normal
+ */
+glm::vec3 cosine_direction(const glm::vec3 &normal, const glm::vec2 &u)
+{
+    // Orthonormal basis around the normal (Duff et al., "Building an Orthonormal Basis, Revisited")
+    const float sign = std::copysign(1.0f, normal.z);
+    const float a = -1.0f / (sign + normal.z);
+    const float b = normal.x * normal.y * a;
+    const glm::vec3 tangent(1.0f + sign * normal.x * normal.x * a, sign * b, -sign * normal.x);
+    const glm::vec3 bitangent(b, sign + normal.y * normal.y * a, -normal.y);
+
+    const float radius = std::sqrt(u.x);
+    const float angle = 2.0f * 3.14159265f * u.y;
+    const float height = std::sqrt(std::max(0.0f, 1.0f - u.x));
+    return glm::normalize(radius * std::cos(angle) * tangent + radius * std::sin(angle) * bitangent
+                          + height * normal);
+}
+
+/**
+ Light reaching a point from one point of one light, sampled from all the lights of the scene, and reflected towards
+ the viewer, with the Phong model of trace_ray, so that the direct light matches the Whitted tracer.
+ */
+glm::vec3 sample_light(const Scene &scene, const glm::vec3 &point, const glm::vec3 &normal,
+                       const glm::vec3 &view_direction, const glm::vec3 &albedo, const Material &material,
+                       Sampler &sampler)
+{
+    const auto &lights = scene.getLights();
+    if (lights.empty())
+        return glm::vec3(0);
+
+    int index;
+    float probability;
+    if (lights.size() > LIGHT_TREE_THRESHOLD) {
+        const std::optional<std::pair<int, float>> picked = scene.getLightTree().pick(point, normal, sampler);
+        if (!picked)
+            return glm::vec3(0);
+        index = picked->first;
+        probability = picked->second;
+    } else {
+        index = std::min((int) (sampler.next() * (float) lights.size()), (int) lights.size() - 1);
+        probability = 1.0f / (float) lights.size();
+    }
+
+    const Light &light = *lights[index];
+    const LightPoint sample = light.samplePoint(sampler.next2D());
+    const glm::vec3 offset = sample.position - point;
+    const float length = glm::length(offset);
+    if (length <= 0)
+        return glm::vec3(0);
+
+    const glm::vec3 brdf = phong_brdf(normal, offset / length, view_direction, albedo, material.specular,
+                                      material.shininess);
+    if (brdf == glm::vec3(0) || is_occluded(scene, point, sample.position, light))
+        return glm::vec3(0);
+
+    const float distance = std::max(0.1f, length);
+    return light.getColor() * brdf * (sample.emission(point) / (distance * distance * probability));
+}
+
+}// namespace
+
+glm::vec3 trace_path(const Scene &scene, const Ray &ray, Sampler &sampler)
+{
+    glm::vec3 radiance(0);
+    glm::vec3 throughput(1);
+    std::optional<Ray> current(ray);
+    // Whether emitters hit next are added: after a diffuse bounce their light was already sampled at the last hit
+    bool add_emission = true;
+
+    for (int bounce = 0; bounce <= MAX_RAY_DEPTH; bounce++) {
+        Stats::recordDepth(bounce);
+        const std::optional<Hit> hit = scene.intersect(*current);
+        if (!hit)
+            break;
+
+        const std::optional<Material> material = hit->object->getSurfaceSafe<Material>();
+        if (!material) {
+            if (add_emission)
+                radiance += throughput * hit->object->getSurface<glm::vec3>();
+            break;
+        }
+
+        const bool inside_object = glm::dot(current->direction, hit->normal) > 0;
+        const glm::vec3 normal = inside_object ? -hit->normal : hit->normal;
+        const glm::vec3 view_direction = glm::normalize(-current->direction);
+        const glm::vec3 albedo = material->texture ? material->diffuse * material->texture(hit->uv) : material->diffuse;
+
+        radiance += throughput
+            * sample_light(scene, hit->intersection, normal, view_direction, albedo, *material, sampler);
+        if (bounce == MAX_RAY_DEPTH)
+            break;
+
+        // One continuation, picked in proportion to the light it carries and weighted by the inverse of that
+        const glm::vec2 factors = specular_factors(normal, view_direction, *material, inside_object);
+        const float diffuse = (albedo.r + albedo.g + albedo.b) / 3.0f;
+        const float total = factors.x + factors.y + diffuse;
+        if (total <= 0)
+            break;
+
+        const float u = sampler.next() * total;
+        glm::vec3 direction;
+        if (u < factors.x) {
+            Stats::increment(Counter::REFLECTION_RAYS);
+            direction = glm::reflect(current->direction, normal);
+            throughput *= total;
+            add_emission = true;
+        } else if (u < factors.x + factors.y) {
+            Stats::increment(Counter::REFRACTION_RAYS);
+            const float n1 = inside_object ? material->refractive_index : 1.0f;
+            const float n2 = inside_object ? 1.0f : material->refractive_index;
+            direction = glm::refract(current->direction, normal, n1 / n2);
+            throughput *= total;
+            add_emission = true;
+        } else {
+            // The albedo / pi BRDF over the cosine / pi density: the weight is the albedo. Since the Phong model of the
+            // lights has no 1 / pi, this treats every light as pi times brighter, as the Whitted tracer does
+            direction = cosine_direction(normal, sampler.next2D());
+            throughput *= albedo * (total / diffuse);
+            add_emission = false;
+        }
+
+        if (bounce + 1 >= PATH_ROULETTE_BOUNCES) {
+            const float survival = std::min(1.0f, std::max(std::max(throughput.r, throughput.g), throughput.b));
+            if (sampler.next() >= survival)
+                break;
+            throughput /= survival;
+        }
+        current.emplace(hit->intersection, direction);
+    }
+    return radiance;
+}
@@ -2,13 +2,25 @@
 // Created by michele on 13.12.23.
 //
 #include "raytracer.h"
+#include "heatmap.h"
 #include "lightning.h"
+#include "pathtracer.h"
 #include "ray.h"
+#include "sampler.h"
+#include "stats.h"
+#include "trace.h"
+#include "writers/writer.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
 #include <omp.h>
 #include <iostream>
+#include <optional>
 
 Raytracer::Raytracer(int width, int height, int fov, std::string outputFile)
-    : _width(width), _height(height), _fov(fov), _outputFile(std::move(outputFile))
+    : _width(width), _height(height), _camera((float) fov), _outputFile(std::move(outputFile)),
+      _writer(std::make_shared<AsyncImageWriter>())
 {
 }
 
@@ -23,12 +35,80 @@ Raytracer &Raytracer::setAntiAliasing(int SSAAFactor)
     return *this;
 }
 
+Raytracer &Raytracer::setCamera(const Camera &camera)
+{
+    this->_camera = camera;
+    return *this;
+}
+
 Raytracer &Raytracer::setOutputFile(std::string outputFile)
 {
     this->_outputFile = std::move(outputFile);
     return *this;
 }
 
+Raytracer &Raytracer::setStatsFile(std::string statsFile)
+{
+    this->_statsFile = std::move(statsFile);
+    return *this;
+}
+
+Raytracer &Raytracer::setCostHeatmaps(bool enabled)
+{
+    this->_costHeatmaps = enabled;
+    return *this;
+}
+
+Raytracer &Raytracer::setTraceFile(std::string traceFile)
+{
+    this->_traceFile = std::move(traceFile);
+    return *this;
+}
+
+Raytracer &Raytracer::setStripHeight(int rows)
+{
+    this->_stripHeight = rows;
+    return *this;
+}
+
+Raytracer &Raytracer::setTemporalReuse(bool enabled)
+{
+    this->_temporal = enabled ? std::make_shared<TemporalCache>() : nullptr;
+    return *this;
+}
+
+Raytracer &Raytracer::setReservoirLighting(bool enabled)
+{
+    this->_reservoirs = enabled ? std::make_shared<ReservoirLighting>() : nullptr;
+    return *this;
+}
+
+Raytracer &Raytracer::setPathTracing(int passes)
+{
+    this->_pathPasses = passes;
+    return *this;
+}
+
+Raytracer &Raytracer::setFilter(Filter filter)
+{
+    this->_filter = filter;
+    return *this;
+}
+
+Raytracer &Raytracer::setThumbnail(std::string thumbnailFile, int size)
+{
+    this->_thumbnailFile = std::move(thumbnailFile);
+    this->_thumbnailSize = size;
+    return *this;
+}
+
+Raytracer &Raytracer::setCheckpoint(std::string checkpointFile, int intervalSeconds)
+{
+    this->_checkpointFile = std::move(checkpointFile);
+    this->_checkpointInterval = intervalSeconds;
+    return *this;
+}
+
 int Raytracer::getWidth() const
 {
     return _width;
@@ -41,7 +121,12 @@ int Raytracer::getHeight() const
 
 int Raytracer::getFov() const
 {
-    return _fov;
+    return (int) _camera.getFov();
+}
+
+const Camera &Raytracer::getCamera() const
+{
+    return _camera;
 }
 
 std::string Raytracer::getOutputFile() const
@@ -49,64 +134,416 @@ std::string Raytracer::getOutputFile() const
     return _outputFile;
 }
 
+std::string Raytracer::getStatsFile() const
+{
+    return _statsFile;
+}
+
+std::string Raytracer::getTraceFile() const
+{
+    return _traceFile;
+}
+
 int Raytracer::getAntiAliasingFactor() const
 {
 
     return _SSAA;
 }
 
-void Raytracer::render(const Scene &scene)
+int Raytracer::getStripHeight() const
+{
+    return _stripHeight;
+}
+
+Filter Raytracer::getFilter() const
 {
-    clock_t t = clock();// variable for keeping the time of the rendering
+    return _filter;
+}
+
+std::string Raytracer::getThumbnailFile() const
+{
+    return _thumbnailFile;
+}
+
+std::string Raytracer::getCheckpointFile() const
+{
+    return _checkpointFile;
+}
+
+bool Raytracer::hasTemporalReuse() const
+{
+    return _temporal != nullptr;
+}
+
+bool Raytracer::hasReservoirLighting() const
+{
+    return _reservoirs != nullptr;
+}
+
+int Raytracer::getPathTracingPasses() const
+{
+    return _pathPasses;
+}
+
+bool Raytracer::hasCostHeatmaps() const
+{
+    return _costHeatmaps;
+}
 
+glm::vec3 Raytracer::renderPixel(const Scene &scene, const Camera &camera, const int i, const int j, const int width,
+                                 const int height, PixelFootprint *footprint)
+{
+    const DOFParams &lens = camera.getLens();
+    glm::vec3 color(0);
+
+    for (int k = 0; k < lens.samples; k++) {
+        const Ray ray = primaryRay(camera, i, j, width, height, k);
+        Stats::increment(Counter::PRIMARY_RAYS);
+        std::optional<Hit> hit;
+        color += trace_ray(scene, ray, footprint ? &hit : nullptr);
+
+        if (footprint) {
+            const std::optional<Material> material = hit ? hit->object->getSurfaceSafe<Material>() : std::nullopt;
+            if (material) {
+                footprint->addHit(hit->intersection);
+                footprint->secondary |= material->reflection > 0 || material->transparency > 0;
+            }
+        }
+    }
+
+    return color / (float) lens.samples;
+}
+
+Ray Raytracer::primaryRay(const Camera &camera, const int i, const int j, const int width, const int height,
+                          const int sample)
+{
+    Sampler sampler((uint32_t) i, (uint32_t) j, (uint32_t) sample);
+    return camera.generateRay(i, j, width, height, sampler.next2D() - 0.5f);
+}
+
+void Raytracer::renderRows(const Scene &scene, Image &image, const int firstRow, CostHeatmap *heatmap) const
+{
     const int width = _width * _SSAA;
-    const int height = _height * _SSAA;
 
-    Image image(width, height);
+    #pragma omp parallel for schedule(dynamic, 1) num_threads(omp_get_max_threads())
+    for (int row = 0; row < image.getHeight(); row++) {
+        const int j = firstRow + row;
+        TRACE_SCOPE("row", j);
+        for (int i = 0; i < width; i++) {
+            Stats::ThreadSlot costBefore;
+            if (heatmap) {
+                costBefore = Stats::local();
+                Stats::local().maxDepth = 0;
+            }
+
+            image.setPixel(i, row, renderPixel(scene, _camera, i, j, width, _height * _SSAA, nullptr));
+
+            if (heatmap)
+                heatmap->record(i, j, costBefore, Stats::local());
+        }
+    }
+}
+
+const Image &Raytracer::renderTemporal(const Scene &scene, CostHeatmap *heatmap)
+{
+    TemporalCache &cache = *_temporal;
+    const std::vector<int> tiles = cache.update(scene, _camera, _width * _SSAA, _height * _SSAA);
+    Image &image = cache.getImage();
+
+    #pragma omp parallel for schedule(dynamic, 1) num_threads(omp_get_max_threads())
+    for (size_t t = 0; t < tiles.size(); t++) {
+        TRACE_SCOPE("tile", tiles[t]);
+        const std::array<int, 4> pixels = cache.getTile(tiles[t]);
+        PixelFootprint &footprint = cache.getFootprint(tiles[t]);
+        footprint = PixelFootprint();
+        for (int j = pixels[1]; j < pixels[3]; j++) {
+            for (int i = pixels[0]; i < pixels[2]; i++) {
+                Stats::ThreadSlot costBefore;
+                if (heatmap) {
+                    costBefore = Stats::local();
+                    Stats::local().maxDepth = 0;
+                }
+
+                const glm::vec3 color = renderPixel(scene, _camera, i, j, image.getWidth(), image.getHeight(),
+                                                    &footprint);
+                image.setPixel(i, j, color);
 
-    const float pixelSize = (2.0f * tan(glm::radians(_fov / 2.0f))) / width;
+                if (heatmap)
+                    heatmap->record(i, j, costBefore, Stats::local());
+            }
+        }
+    }
 
-    const float sceneLeft = (float) -width * pixelSize / 2.0f;
-    const float sceneTop = (float) height * pixelSize / 2.0f;
+    std::cout << "Traced " << tiles.size() << " of " << cache.getTileCount() << " tiles." << std::endl;
+    return image;
+}
 
-    const float focalLength = Raytracer::DOF_PARAMS.focalLength;
+void Raytracer::renderCheckpointed(const Scene &scene, Image &image, CostHeatmap *heatmap) const
+{
+    Checkpoint checkpoint(_checkpointFile, _outputFile, image.getWidth(), image.getHeight());
+    if (checkpoint.load(image))
+        std::cout << "Resuming from " << _checkpointFile << " with " << checkpoint.getCompletedCount() << " of "
+                  << checkpoint.getTileCount() << " tiles done." << std::endl;
 
-    #pragma omp parallel for schedule(dynamic, 1) collapse(2) num_threads(omp_get_max_threads())
-    for (int i = 0; i < width; i++)
-        for (int j = 0; j < height; j++) {
-            glm::vec3 origin(0, 0, 0);
+    const int samples = _camera.getLens().samples;
+    auto lastSave = std::chrono::steady_clock::now();
 
-            const float x = sceneLeft + (float) i * pixelSize + pixelSize / 2.0f;
-            const float y = sceneTop - (float) j * pixelSize - pixelSize / 2.0f;
-            const float z = SCENE_Z;
-            glm::vec3 direction(x, y, z);
-            direction = glm::normalize(direction);
+    #pragma omp parallel for schedule(dynamic, 1) num_threads(omp_get_max_threads())
+    for (int tile = 0; tile < checkpoint.getTileCount(); tile++) {
+        if (checkpoint.isDone(tile))
+            continue;
 
-            const glm::vec3 focalPoint = focalLength * direction / direction.z;
+        TRACE_SCOPE("tile", tile);
+        const std::array<int, 4> pixels = checkpoint.getTile(tile);
+        for (int j = pixels[1]; j < pixels[3]; j++) {
+            for (int i = pixels[0]; i < pixels[2]; i++) {
+                Stats::ThreadSlot costBefore;
+                if (heatmap) {
+                    costBefore = Stats::local();
+                    Stats::local().maxDepth = 0;
+                }
 
-            glm::vec3 color(0);
+                // Accumulate the samples one by one, so that the checkpoint records how many each pixel has
+                for (int k = 0; k < samples; k++) {
+                    Stats::increment(Counter::PRIMARY_RAYS);
+                    image.addSample(i, j, trace_ray(scene, primaryRay(_camera, i, j, image.getWidth(),
+                                                                      image.getHeight(), k)));
+                }
 
-            for (int k = 0; k < Raytracer::DOF_PARAMS.samples; k++) {
-                const glm::vec3 offset = glm::vec3(
-                    (((float) rand() / ((float) RAND_MAX)) - 0.5) * Raytracer::DOF_PARAMS.aperture,
-                    (((float) rand() / ((float) RAND_MAX)) - 0.5) * Raytracer::DOF_PARAMS.aperture,
-                    0);
-                const glm::vec3 newOrigin = origin + offset;
-                const glm::vec3 newDirection = glm::normalize(focalPoint - newOrigin);
-                color += trace_ray(scene, Ray(newOrigin, newDirection), 0);
+                if (heatmap)
+                    heatmap->record(i, j, costBefore, Stats::local());
             }
+        }
 
-            color /= (float) Raytracer::DOF_PARAMS.samples;
-            image.setPixel(i, j, tone_mapping(color));
+        // Only complete tiles are saved, and they are not written again, so the other threads can go on meanwhile
+        #pragma omp critical(checkpoint)
+        {
+            checkpoint.markDone(tile);
+            const std::chrono::duration<double> sinceSave = std::chrono::steady_clock::now() - lastSave;
+            if (sinceSave.count() >= _checkpointInterval && checkpoint.getCompletedCount() < checkpoint.getTileCount()) {
+                TRACE_SCOPE("checkpoint");
+                checkpoint.save(image);
+                lastSave = std::chrono::steady_clock::now();
+            }
+        }
+    }
 
-            //            Ray ray(origin, direction);// ray traversal
-            //
-            //            image.setPixel(i, j, tone_mapping(trace_ray(scene, ray)));
+    checkpoint.remove();
+}
+
+void Raytracer::renderPaths(const Scene &scene, Image &image) const
+{
+    const int samples = _camera.getLens().samples;
+    for (int pass = 0; pass < _pathPasses; pass++) {
+        TRACE_SCOPE("path_pass", pass);
+        #pragma omp parallel for schedule(dynamic, 1) num_threads(omp_get_max_threads())
+        for (int j = 0; j < image.getHeight(); j++) {
+            for (int i = 0; i < image.getWidth(); i++) {
+                for (int k = 0; k < samples; k++) {
+                    // Each path draws from its own stream, so the image does not depend on the threads
+                    const int index = pass * samples + k;
+                    Sampler sampler((uint32_t) i, (uint32_t) j, ~(uint32_t) index);
+                    Stats::increment(Counter::PRIMARY_RAYS);
+                    image.addSample(i, j, trace_path(scene, primaryRay(_camera, i, j, image.getWidth(),
+                                                                       image.getHeight(), index), sampler));
+                }
+            }
         }
+    }
+}
+
+void Raytracer::render(const Scene &scene)
+{
+    if (_stripHeight > 0 && _stripHeight < _height) {
+        renderStrips(scene);
+        return;
+    }
+
+    std::optional<ScopedTimer> renderTimer(Phase::RENDER);
 
-    t = clock() - t;
-    std::cout << "It took " << ((float) t) / CLOCKS_PER_SEC << " seconds to render the image." << std::endl;
-    std::cout << "I could render at " << (float) CLOCKS_PER_SEC / ((float) t) << " frames per second." << std::endl;
+    // Reservoir lighting and the path tracer do not record the cost of the pixels: no heatmap rather than blank ones
+    const bool alternativeLighting = !_temporal && (_reservoirs || _pathPasses > 0);
+    std::optional<CostHeatmap> heatmap;
+    if (_costHeatmaps && !alternativeLighting)
+        heatmap.emplace(_width * _SSAA, _height * _SSAA);
+
+    if (_temporal && !_checkpointFile.empty())
+        std::cerr << "Checkpoints are not saved when reusing frames" << std::endl;
+    if (_temporal && _reservoirs)
+        std::cerr << "Reservoir lighting is not used when reusing frames" << std::endl;
+    if (_pathPasses > 0 && _temporal)
+        std::cerr << "The path tracer is not used when reusing frames" << std::endl;
+    else if (_pathPasses > 0 && _reservoirs)
+        std::cerr << "Reservoir lighting is not used by the path tracer" << std::endl;
+    if (alternativeLighting && (_costHeatmaps || !_checkpointFile.empty()))
+        std::cerr << "Cost heatmaps and checkpoints are not supported with reservoir lighting or path tracing"
+                  << std::endl;
+
+    std::optional<Image> fullImage;
+    if (!_temporal) {
+        fullImage.emplace(_width * _SSAA, _height * _SSAA);
+        if (_pathPasses > 0)
+            renderPaths(scene, *fullImage);
+        else if (_reservoirs)
+            _reservoirs->render(scene, _camera, *fullImage);
+        else if (_checkpointFile.empty())
+            renderRows(scene, *fullImage, 0, heatmap ? &*heatmap : nullptr);
+        else
+            renderCheckpointed(scene, *fullImage, heatmap ? &*heatmap : nullptr);
+    }
+    const Image &image = _temporal ? renderTemporal(scene, heatmap ? &*heatmap : nullptr) : *fullImage;
+
+    std::cout << "It took " << renderTimer->elapsed() << " seconds to render the image." << std::endl;
+    renderTimer.reset();
+
+    std::optional<ScopedTimer> outputTimer(Phase::IMAGE_OUTPUT);
+    Image resolved = image.downsample(_SSAA, _filter);
+    if (!_thumbnailFile.empty() && _thumbnailSize > 0) {
+        const float scale = (float) _thumbnailSize / (float) std::max(_width, _height);
+        const int thumbnailWidth = std::max(1, (int) std::lround((float) _width * scale));
+        const int thumbnailHeight = std::max(1, (int) std::lround((float) _height * scale));
+        _writer->submit(resolved.resize(thumbnailWidth, thumbnailHeight, _filter), _thumbnailFile, tone_mapping);
+    }
+    outputTimer.reset();
+    _writer->submit(std::move(resolved), _outputFile, tone_mapping);
+    if (heatmap)
+        heatmap->write(_outputFile, _SSAA);
+}
+
+void Raytracer::renderStrips(const Scene &scene)
+{
+    if (_costHeatmaps)
+        std::cerr << "Cost heatmaps are not recorded when rendering in strips" << std::endl;
+    if (!_thumbnailFile.empty())
+        std::cerr << "Thumbnails are not written when rendering in strips" << std::endl;
+    if (_temporal)
+        std::cerr << "Frames are not reused when rendering in strips" << std::endl;
+    if (_reservoirs)
+        std::cerr << "Reservoir lighting is not used when rendering in strips" << std::endl;
+    if (_pathPasses > 0)
+        std::cerr << "The path tracer is not used when rendering in strips" << std::endl;
+    if (!_checkpointFile.empty())
+        std::cerr << "Checkpoints are not saved when rendering in strips" << std::endl;
+
+    const auto startTime = std::chrono::steady_clock::now();
+
+    const std::unique_ptr<ImageWriter> writer = ImageWriter::create(_outputFile, tone_mapping);
+    writer->open(_outputFile, _width, _height);
+
+    // Rows of the neighbouring strips that the filter reaches, rendered again so that the strips join without seams
+    const int margin = _SSAA > 1 ? (int) std::ceil(getFilterRadius(_filter)) : 0;
+
+    std::vector<glm::vec3> rows((size_t) _stripHeight * _width);
+    for (int y = 0; y < _height; y += _stripHeight) {
+        const int count = std::min(_stripHeight, _height - y);
+        const int first = std::max(y - margin, 0);
+        const int last = std::min(y + count + margin, _height);
+
+        Image strip(_width * _SSAA, (last - first) * _SSAA);
+        {
+            ScopedTimer timer(Phase::RENDER);
+            renderRows(scene, strip, first * _SSAA, nullptr);
+        }
+
+        ScopedTimer timer(Phase::IMAGE_OUTPUT);
+        strip.downsample(_SSAA, _filter).resolveRows(y - first, count, rows.data());
+        writer->writeRows(rows.data(), count);
+    }
+    writer->close();
+
+    const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - startTime;
+    std::cout << "It took " << elapsed.count() << " seconds to render and write the image in strips of "
+              << _stripHeight << " rows." << std::endl;
+}
+
+void Raytracer::renderAnimation(Scene &scene, const int firstFrame, const int lastFrame, const FrameUpdate &update,
+                                const std::string &framePattern)
+{
+    const std::string outputFile = _outputFile;
+    const auto startTime = std::chrono::steady_clock::now();
+
+    std::vector<char> path(framePattern.size() + 32);
+    for (int frame = firstFrame; frame <= lastFrame; frame++) {
+        TRACE_SCOPE("frame", frame);
+        update(scene, frame);
+        scene.rebuild();
+
+        std::snprintf(path.data(), path.size(), framePattern.c_str(), frame);
+        _outputFile = path.data();
+        render(scene);
+    }
+    _outputFile = outputFile;
+
+    _writer->wait();
+    const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - startTime;
+    std::cout << "It took " << elapsed.count() << " seconds to render and write " << lastFrame - firstFrame + 1
+              << " frames." << std::endl;
+}
+
+void Raytracer::renderViews(const Scene &scene, const std::vector<Camera> &cameras, const std::string &viewPattern)
+{
+    if (_costHeatmaps)
+        std::cerr << "Cost heatmaps are not recorded when rendering several views" << std::endl;
+    if (!_thumbnailFile.empty())
+        std::cerr << "Thumbnails are not written when rendering several views" << std::endl;
+    if (_temporal)
+        std::cerr << "Frames are not reused when rendering several views" << std::endl;
+    if (_reservoirs)
+        std::cerr << "Reservoir lighting is not used when rendering several views" << std::endl;
+    if (_pathPasses > 0)
+        std::cerr << "The path tracer is not used when rendering several views" << std::endl;
+    if (!_checkpointFile.empty())
+        std::cerr << "Checkpoints are not saved when rendering several views" << std::endl;
+    if (_stripHeight > 0)
+        std::cerr << "Views are not rendered in strips" << std::endl;
+
+    std::optional<ScopedTimer> renderTimer(Phase::RENDER);
+
+    const int width = _width * _SSAA;
+    const int height = _height * _SSAA;
+    const int tilesX = (width + TILE_SIZE - 1) / TILE_SIZE;
+    const int tilesY = (height + TILE_SIZE - 1) / TILE_SIZE;
+    const int tilesPerView = tilesX * tilesY;
+
+    std::vector<Image> images;
+    images.reserve(cameras.size());
+    for (size_t view = 0; view < cameras.size(); view++) {
+        images.emplace_back(width, height);
+    }
+
+    // One flat list of tiles across the views, so that no thread idles while another finishes the last view
+    const int tiles = tilesPerView * (int) cameras.size();
+    #pragma omp parallel for schedule(dynamic, 1) num_threads(omp_get_max_threads())
+    for (int tile = 0; tile < tiles; tile++) {
+        const int view = tile / tilesPerView;
+        const int x = (tile % tilesPerView) % tilesX * TILE_SIZE;
+        const int y = (tile % tilesPerView) / tilesX * TILE_SIZE;
+        TRACE_SCOPE("tile", tile);
+        for (int j = y; j < std::min(y + TILE_SIZE, height); j++) {
+            for (int i = x; i < std::min(x + TILE_SIZE, width); i++) {
+                images[view].setPixel(i, j, renderPixel(scene, cameras[view], i, j, width, height, nullptr));
+            }
+        }
+    }
+
+    std::cout << "It took " << renderTimer->elapsed() << " seconds to render " << cameras.size() << " views."
+              << std::endl;
+    renderTimer.reset();
+
+    std::vector<char> path(viewPattern.size() + 32);
+    for (size_t view = 0; view < cameras.size(); view++) {
+        std::snprintf(path.data(), path.size(), viewPattern.c_str(), (int) view);
+        _writer->submit(images[view].downsample(_SSAA, _filter), path.data(), tone_mapping);
+    }
+}
+
+void Raytracer::finish()
+{
+    _writer->wait();
 
-    std::move(image.downsample(_SSAA)).writeImage("result.ppm");
+    Stats::get().print(std::cout);
+    if (!_statsFile.empty())
+        Stats::get().writeJSON(_statsFile);
+    if (!_traceFile.empty())
+        writeTrace(_traceFile);
 }
\ No newline at end of file
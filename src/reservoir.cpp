@@ -0,0 +1,206 @@
+//
+// Created by michele on 19.10.26.
+//
+
+#include "reservoir.h"
+#include "lightning.h"
+#include "raytracer.h"
+#include "sampler.h"
+#include "stats.h"
+#include "trace.h"
+#include <algorithm>
+#include <cmath>
+#include <omp.h>
+
+void Reservoir::update(const int light, const LightPoint &point, const float weight, const float target,
+                       const float candidates, const float u)
+{
+    weightSum += weight;
+    count += candidates;
+    if (weight > 0 && u * weightSum < weight) {
+        this->light = light;
+        this->point = point;
+        this->target = target;
+    }
+}
+
+glm::vec3 ReservoirLighting::contribution(const Light &light, const LightPoint &point, const Surface &surface)
+{
+    const glm::vec3 offset = point.position - surface.point;
+    const float length = glm::length(offset);
+    if (length <= 0)
+        return glm::vec3(0);
+
+    const float distance = std::max(0.1f, length);
+    return light.getColor() * (point.emission(surface.point) / (distance * distance))
+        * phong_brdf(surface.normal, offset / length, surface.view, surface.albedo, surface.specular,
+                     surface.shininess);
+}
+
+bool ReservoirLighting::isSimilar(const Surface &surface, const glm::vec3 &normal, const float depth)
+{
+    return glm::dot(surface.normal, normal) > 0.9f && std::abs(depth - surface.depth) < 0.1f * surface.depth;
+}
+
+void ReservoirLighting::sampleLayer(const Scene &scene, const Camera &camera, const int layer, const bool reuseHistory)
+{
+    const auto &lights = scene.getLights();
+    const bool fromTree = lights.size() > LIGHT_TREE_THRESHOLD;
+
+    #pragma omp parallel for schedule(dynamic, 1) num_threads(omp_get_max_threads())
+    for (int j = 0; j < height; j++) {
+        TRACE_SCOPE("reservoir_sample", j);
+        for (int i = 0; i < width; i++) {
+            const size_t index = (size_t) j * width + i;
+            Surface &surface = surfaces[index];
+            Reservoir &reservoir = reservoirs[index];
+            surface.valid = false;
+            base[index] = glm::vec3(0);
+            reservoir = Reservoir();
+
+            const Ray ray = Raytracer::primaryRay(camera, i, j, width, height, layer);
+            Stats::increment(Counter::PRIMARY_RAYS);
+            const std::optional<Hit> hit = scene.intersect(ray);
+            if (!hit)
+                continue;
+            const std::optional<Material> material = hit->object->getSurfaceSafe<Material>();
+            if (!material) {
+                base[index] = hit->object->getSurface<glm::vec3>();
+                continue;
+            }
+
+            const bool inside = glm::dot(ray.direction, hit->normal) > 0;
+            surface = {hit->intersection,
+                       inside ? -hit->normal : hit->normal,
+                       glm::normalize(-ray.direction),
+                       material->texture ? material->diffuse * material->texture(hit->uv) : material->diffuse,
+                       material->specular,
+                       material->shininess,
+                       hit->distance,
+                       true};
+            base[index] = material->ambient * scene.getAmbientLight()
+                + trace_secondary(scene, ray, *hit, *material);
+            if (lights.empty())
+                continue;
+
+            // New candidates, kept in proportion to their unshadowed contribution over the probability of drawing them
+            Sampler sampler((uint32_t) i, (uint32_t) j, frame * (uint32_t) layers + (uint32_t) layer);
+            for (int c = 0; c < CANDIDATES; c++) {
+                int light;
+                float probability;
+                if (fromTree) {
+                    const std::optional<std::pair<int, float>> picked =
+                            scene.getLightTree().pick(surface.point, surface.normal, sampler);
+                    if (!picked) {
+                        reservoir.count++;
+                        continue;
+                    }
+                    light = picked->first;
+                    probability = picked->second;
+                } else {
+                    light = std::min((int) (sampler.next() * (float) lights.size()), (int) lights.size() - 1);
+                    probability = 1.0f / (float) lights.size();
+                }
+                const LightPoint point = lights[light]->samplePoint(sampler.next2D());
+                const float target = luminance(contribution(*lights[light], point, surface));
+                reservoir.update(light, point, target / probability, target, 1, sampler.next());
+            }
+
+            // An occluded point would only spread darkness to the neighbours: drop it, still counting the candidates
+            if (reservoir.light >= 0
+                && is_occluded(scene, surface.point, reservoir.point.position, *lights[reservoir.light])) {
+                reservoir.light = -1;
+                reservoir.target = 0;
+                reservoir.weightSum = 0;
+            }
+
+            if (reuseHistory) {
+                const size_t past = (size_t) layer * width * height + index;
+                const Reservoir &old = previous[past];
+                if (history[past].valid && old.light >= 0 && isSimilar(surface, history[past].normal, history[past].depth)) {
+                    const float count = std::min(old.count, MAX_HISTORY * CANDIDATES);
+                    const float target = luminance(contribution(*lights[old.light], old.point, surface));
+                    reservoir.update(old.light, old.point, target * old.getWeight() * count, target, count,
+                                     sampler.next());
+                }
+            }
+        }
+    }
+}
+
+void ReservoirLighting::resolveLayer(const Scene &scene, const int layer, Image &image)
+{
+    const auto &lights = scene.getLights();
+
+    #pragma omp parallel for schedule(dynamic, 1) num_threads(omp_get_max_threads())
+    for (int j = 0; j < height; j++) {
+        TRACE_SCOPE("reservoir_resolve", j);
+        for (int i = 0; i < width; i++) {
+            const size_t index = (size_t) j * width + i;
+            const Surface &surface = surfaces[index];
+            Reservoir result = reservoirs[index];
+            glm::vec3 color = base[index];
+
+            if (surface.valid) {
+                Sampler sampler((uint32_t) i, (uint32_t) j, ~(frame * (uint32_t) layers + (uint32_t) layer));
+                for (int n = 0; n < NEIGHBOURS; n++) {
+                    const int x = i + (int) std::lround((2 * sampler.next() - 1) * RADIUS);
+                    const int y = j + (int) std::lround((2 * sampler.next() - 1) * RADIUS);
+                    const float u = sampler.next();
+                    if (x < 0 || y < 0 || x >= width || y >= height || (x == i && y == j))
+                        continue;
+                    const size_t other = (size_t) y * width + x;
+                    if (!surfaces[other].valid || !isSimilar(surface, surfaces[other].normal, surfaces[other].depth))
+                        continue;
+
+                    const Reservoir &neighbour = reservoirs[other];
+                    if (neighbour.light < 0) {
+                        result.count += neighbour.count;
+                        continue;
+                    }
+                    const float target = luminance(contribution(*lights[neighbour.light], neighbour.point, surface));
+                    result.update(neighbour.light, neighbour.point, target * neighbour.getWeight() * neighbour.count,
+                                  target, neighbour.count, u);
+                }
+
+                if (result.light >= 0) {
+                    const Light &light = *lights[result.light];
+                    const glm::vec3 direct = contribution(light, result.point, surface) * result.getWeight();
+                    if (direct != glm::vec3(0) && !is_occluded(scene, surface.point, result.point.position, light))
+                        color += direct;
+                }
+            }
+
+            const size_t past = (size_t) layer * width * height + index;
+            previous[past] = result;
+            history[past] = {surface.normal, surface.depth, surface.valid};
+            image.addSample(i, j, color);
+        }
+    }
+}
+
+void ReservoirLighting::render(const Scene &scene, const Camera &camera, Image &image)
+{
+    const int samples = camera.getLens().samples;
+    const bool reuseHistory = frame > 0 && image.getWidth() == width && image.getHeight() == height
+        && samples == layers && scene.getLights().size() == lightCount;
+    if (!reuseHistory) {
+        width = image.getWidth();
+        height = image.getHeight();
+        layers = samples;
+        lightCount = scene.getLights().size();
+        previous.assign((size_t) width * height * layers, Reservoir());
+        history.assign((size_t) width * height * layers, History{glm::vec3(0), 0, false});
+    }
+
+    surfaces.resize((size_t) width * height);
+    base.resize((size_t) width * height);
+    reservoirs.resize((size_t) width * height);
+
+    // One lens sample at a time, so that the buffers of a single layer are enough
+    for (int layer = 0; layer < layers; layer++) {
+        sampleLayer(scene, camera, layer, reuseHistory);
+        resolveLayer(scene, layer, image);
+    }
+    frame++;
+}
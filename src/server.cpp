@@ -0,0 +1,194 @@
+//
+// Created by michele on 19.10.26.
+//
+
+#include "server.h"
+#include "lightning.h"
+#include "raytracer.h"
+#include "trace.h"
+#include "writers/writer.h"
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <omp.h>
+#include <sstream>
+#include <sys/socket.h>
+#include <unistd.h>
+
+RenderServer &RenderServer::addScene(const std::string &name, SceneSetup setup)
+{
+    definitions[name] = std::move(setup);
+    return *this;
+}
+
+std::shared_ptr<Scene> RenderServer::getScene(const std::string &name)
+{
+    std::lock_guard<std::mutex> lock(scenesMutex);
+    const auto scene = scenes.find(name);
+    return scene == scenes.end() ? nullptr : scene->second;
+}
+
+bool RenderServer::serve(const std::string &path)
+{
+    listener = Socket::listenLocal(path);
+    if (!listener.isValid())
+        return false;
+
+    std::cout << "Serving on " << path << std::endl;
+    running = true;
+    while (running) {
+        Socket client = listener.accept();
+        if (!client.isValid())
+            break;
+
+        std::lock_guard<std::mutex> lock(clientsMutex);
+        for (const std::thread::id id : finishedClients) {
+            const auto thread = std::find_if(clientThreads.begin(), clientThreads.end(),
+                                             [id](const std::thread &thread) { return thread.get_id() == id; });
+            thread->join();
+            clientThreads.erase(thread);
+        }
+        finishedClients.clear();
+        clientDescriptors.push_back(client.getDescriptor());
+        clientThreads.emplace_back(&RenderServer::serveClient, this, std::move(client));
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(clientsMutex);
+        for (const int descriptor : clientDescriptors) {
+            ::shutdown(descriptor, SHUT_RDWR);
+        }
+    }
+    for (auto &thread : clientThreads) {
+        thread.join();
+    }
+    clientThreads.clear();
+    clientDescriptors.clear();
+    finishedClients.clear();
+    listener.close();
+    ::unlink(path.c_str());
+    return true;
+}
+
+void RenderServer::serveClient(Socket client)
+{
+    while (const std::optional<std::string> request = client.readLine()) {
+        if (!handle(client, *request))
+            break;
+    }
+
+    std::lock_guard<std::mutex> lock(clientsMutex);
+    clientDescriptors.erase(std::remove(clientDescriptors.begin(), clientDescriptors.end(), client.getDescriptor()),
+                            clientDescriptors.end());
+    finishedClients.push_back(std::this_thread::get_id());
+}
+
+bool RenderServer::handle(Socket &client, const std::string &request)
+{
+    std::istringstream words(request);
+    std::string command;
+    words >> command;
+
+    if (command == "QUIT")
+        return false;
+
+    if (command == "SHUTDOWN") {
+        running = false;
+        client.writeLine("OK");
+        // Wake up the accept() of serve()
+        listener.shutdown();
+        return false;
+    }
+
+    if (command == "SCENES") {
+        std::string names;
+        for (const auto &definition : definitions) {
+            names += " " + definition.first;
+        }
+        return client.writeLine("OK" + names);
+    }
+
+    std::string name;
+    words >> name;
+
+    if (command == "LOAD") {
+        const auto definition = definitions.find(name);
+        if (definition == definitions.end())
+            return client.writeLine("ERROR unknown scene " + name);
+
+        const auto startTime = std::chrono::steady_clock::now();
+        {
+            std::lock_guard<std::mutex> lock(scenesMutex);
+            if (scenes.find(name) == scenes.end()) {
+                auto scene = std::make_shared<Scene>();
+                definition->second(*scene);
+                scenes[name] = scene;
+            }
+        }
+        const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - startTime;
+        return client.writeLine("OK " + std::to_string(elapsed.count()));
+    }
+
+    if (command == "UNLOAD") {
+        std::lock_guard<std::mutex> lock(scenesMutex);
+        if (scenes.erase(name) == 0)
+            return client.writeLine("ERROR scene " + name + " is not loaded");
+        return client.writeLine("OK");
+    }
+
+    if (command == "RENDER") {
+        int width = 0, height = 0, samples = 0;
+        std::string format;
+        glm::vec3 position, target;
+        float fov = 0;
+        words >> width >> height >> samples >> format >> position.x >> position.y >> position.z >> target.x >>
+            target.y >> target.z >> fov;
+        if (!words || width <= 0 || height <= 0 || samples <= 0 || fov <= 0)
+            return client.writeLine("ERROR malformed request: " + request);
+        // An image too large to allocate would throw in this thread and terminate the server
+        if (width > MAX_IMAGE_SIZE || height > MAX_IMAGE_SIZE || samples > MAX_SAMPLES)
+            return client.writeLine("ERROR at most " + std::to_string(MAX_IMAGE_SIZE) + "x"
+                                    + std::to_string(MAX_IMAGE_SIZE) + " pixels and "
+                                    + std::to_string(MAX_SAMPLES) + " samples");
+
+        const std::shared_ptr<Scene> scene = getScene(name);
+        if (!scene)
+            return client.writeLine("ERROR scene " + name + " is not loaded");
+        const std::unique_ptr<ImageWriter> writer = ImageWriter::createForFormat(format, tone_mapping);
+        if (!writer)
+            return client.writeLine("ERROR unknown format " + format);
+
+        DOFParams lens = Camera::DEFAULT_LENS;
+        lens.samples = samples;
+        Camera camera(fov, lens);
+        camera.setPosition(position).lookAt(target);
+
+        Image image(width, height);
+        {
+            std::lock_guard<std::mutex> lock(renderMutex);
+            TRACE_SCOPE("server_render");
+            ScopedTimer timer(Phase::RENDER);
+            #pragma omp parallel for schedule(dynamic, 1) num_threads(omp_get_max_threads())
+            for (int j = 0; j < height; j++) {
+                for (int i = 0; i < width; i++) {
+                    image.setPixel(i, j, Raytracer::renderPixel(*scene, camera, i, j, width, height, nullptr));
+                }
+            }
+            std::cout << "Rendered " << name << " at " << width << "x" << height << " in " << timer.elapsed()
+                      << " seconds." << std::endl;
+        }
+
+        std::ostringstream encoded;
+        writer->write(image, encoded);
+        const std::string bytes = encoded.str();
+        const std::streamoff expected = writer->getEncodedSize();
+        if (!encoded || (expected >= 0 && (std::streamoff) bytes.size() != expected)) {
+            std::cerr << "Encoded " << bytes.size() << " bytes instead of " << expected << " for " << request
+                      << std::endl;
+            return client.writeLine("ERROR cannot encode the image as " + format);
+        }
+        return client.writeLine("OK " + std::to_string(bytes.size())) && client.writeAll(bytes.data(), bytes.size());
+    }
+
+    return client.writeLine("ERROR unknown command " + command);
+}
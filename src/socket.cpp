@@ -0,0 +1,257 @@
+//
+// Created by michele on 19.10.26.
+//
+
+#include "socket.h"
+#include <algorithm>
+#include <arpa/inet.h>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+Socket::~Socket()
+{
+    close();
+}
+
+Socket::Socket(Socket &&other) noexcept : fd(other.fd), buffer(std::move(other.buffer))
+{
+    other.fd = -1;
+}
+
+Socket &Socket::operator=(Socket &&other) noexcept
+{
+    if (this != &other) {
+        close();
+        fd = other.fd;
+        buffer = std::move(other.buffer);
+        other.fd = -1;
+    }
+    return *this;
+}
+
+static bool localAddress(const std::string &path, sockaddr_un &address)
+{
+    std::memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(address.sun_path)) {
+        std::cerr << "Socket path too long: " << path << std::endl;
+        return false;
+    }
+    std::strcpy(address.sun_path, path.c_str());
+    return true;
+}
+
+Socket Socket::listenLocal(const std::string &path)
+{
+    sockaddr_un address{};
+    if (!localAddress(path, address))
+        return {};
+
+    Socket socket(::socket(AF_UNIX, SOCK_STREAM, 0));
+    ::unlink(path.c_str());
+    if (!socket.isValid() || ::bind(socket.fd, (const sockaddr *) &address, sizeof(address)) < 0 ||
+        ::listen(socket.fd, SOMAXCONN) < 0) {
+        std::cerr << "Cannot listen on " << path << ": " << std::strerror(errno) << std::endl;
+        return {};
+    }
+    return socket;
+}
+
+Socket Socket::connectLocal(const std::string &path)
+{
+    sockaddr_un address{};
+    if (!localAddress(path, address))
+        return {};
+
+    Socket socket(::socket(AF_UNIX, SOCK_STREAM, 0));
+    if (!socket.isValid() || ::connect(socket.fd, (const sockaddr *) &address, sizeof(address)) < 0) {
+        std::cerr << "Cannot connect to " << path << ": " << std::strerror(errno) << std::endl;
+        return {};
+    }
+    return socket;
+}
+
+Socket Socket::listenTCP(const int port)
+{
+    Socket socket(::socket(AF_INET, SOCK_STREAM, 0));
+    const int enable = 1;
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_ANY);
+    address.sin_port = htons((uint16_t) port);
+    if (!socket.isValid() || ::setsockopt(socket.fd, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable)) < 0 ||
+        ::bind(socket.fd, (const sockaddr *) &address, sizeof(address)) < 0 || ::listen(socket.fd, SOMAXCONN) < 0) {
+        std::cerr << "Cannot listen on port " << port << ": " << std::strerror(errno) << std::endl;
+        return {};
+    }
+    return socket;
+}
+
+Socket Socket::connectTCP(const std::string &host, const int port)
+{
+    addrinfo hints{};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo *addresses = nullptr;
+    if (::getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints, &addresses) != 0) {
+        std::cerr << "Cannot resolve " << host << std::endl;
+        return {};
+    }
+
+    Socket socket;
+    for (const addrinfo *address = addresses; address; address = address->ai_next) {
+        socket = Socket(::socket(address->ai_family, address->ai_socktype, address->ai_protocol));
+        if (socket.isValid() && ::connect(socket.fd, address->ai_addr, address->ai_addrlen) == 0)
+            break;
+        socket.close();
+    }
+    ::freeaddrinfo(addresses);
+
+    if (!socket.isValid()) {
+        std::cerr << "Cannot connect to " << host << ":" << port << std::endl;
+        return {};
+    }
+    // Requests and replies are small messages waiting for each other: do not delay them
+    const int enable = 1;
+    ::setsockopt(socket.fd, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+    return socket;
+}
+
+/**
+ @return the port number of text, or -1 reporting the error if it is not one
+ */
+static int parsePort(const std::string &text)
+{
+    char *end = nullptr;
+    errno = 0;
+    const long port = std::strtol(text.c_str(), &end, 10);
+    if (text.empty() || *end != '\0' || errno != 0 || port < 0 || port > 65535) {
+        std::cerr << "Invalid port: " << text << std::endl;
+        return -1;
+    }
+    return (int) port;
+}
+
+Socket Socket::connect(const std::string &address)
+{
+    const size_t colon = address.find_last_of(':');
+    if (colon == std::string::npos || address.find('/') != std::string::npos)
+        return connectLocal(address);
+    const int port = parsePort(address.substr(colon + 1));
+    if (port < 0)
+        return {};
+    return connectTCP(address.substr(0, colon), port);
+}
+
+Socket Socket::listen(const std::string &address)
+{
+    const size_t colon = address.find_last_of(':');
+    if (colon == std::string::npos || address.find('/') != std::string::npos)
+        return listenLocal(address);
+    const int port = parsePort(address.substr(colon + 1));
+    if (port < 0)
+        return {};
+    return listenTCP(port);
+}
+
+int Socket::getPort() const
+{
+    sockaddr_in address{};
+    socklen_t length = sizeof(address);
+    if (::getsockname(fd, (sockaddr *) &address, &length) < 0 || address.sin_family != AF_INET)
+        return -1;
+    return ntohs(address.sin_port);
+}
+
+Socket Socket::accept() const
+{
+    int client;
+    do {
+        client = ::accept(fd, nullptr, nullptr);
+    } while (client < 0 && errno == EINTR);
+    return Socket(client);
+}
+
+std::optional<std::string> Socket::readLine()
+{
+    while (true) {
+        const size_t newline = buffer.find('\n');
+        if (newline != std::string::npos) {
+            std::string line = buffer.substr(0, newline);
+            buffer.erase(0, newline + 1);
+            return line;
+        }
+
+        char chunk[4096];
+        const ssize_t received = ::recv(fd, chunk, sizeof(chunk), 0);
+        if (received < 0 && errno == EINTR)
+            continue;
+        if (received <= 0)
+            return std::nullopt;
+        buffer.append(chunk, (size_t) received);
+    }
+}
+
+bool Socket::readExact(void *data, size_t size)
+{
+    char *out = (char *) data;
+    const size_t buffered = std::min(size, buffer.size());
+    std::memcpy(out, buffer.data(), buffered);
+    buffer.erase(0, buffered);
+    out += buffered;
+    size -= buffered;
+
+    while (size > 0) {
+        const ssize_t received = ::recv(fd, out, size, 0);
+        if (received < 0 && errno == EINTR)
+            continue;
+        if (received <= 0)
+            return false;
+        out += received;
+        size -= (size_t) received;
+    }
+    return true;
+}
+
+bool Socket::writeAll(const void *data, size_t size)
+{
+    const char *in = (const char *) data;
+    while (size > 0) {
+        // MSG_NOSIGNAL: a peer gone away is reported as an error rather than killing the process with SIGPIPE
+        const ssize_t sent = ::send(fd, in, size, MSG_NOSIGNAL);
+        if (sent < 0 && errno == EINTR)
+            continue;
+        if (sent <= 0)
+            return false;
+        in += sent;
+        size -= (size_t) sent;
+    }
+    return true;
+}
+
+bool Socket::writeLine(const std::string &line)
+{
+    const std::string data = line + "\n";
+    return writeAll(data.data(), data.size());
+}
+
+void Socket::shutdown()
+{
+    if (fd >= 0)
+        ::shutdown(fd, SHUT_RDWR);
+}
+
+void Socket::close()
+{
+    if (fd >= 0)
+        ::close(fd);
+    fd = -1;
+}
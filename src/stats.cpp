@@ -0,0 +1,140 @@
+//
+// Created by michele on 19.10.26.
+//
+
+#include "stats.h"
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+
+Stats &Stats::get()
+{
+    static Stats stats;
+    return stats;
+}
+
+Stats::ThreadSlot &Stats::registerThread()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return slots.emplace_back();
+}
+
+void Stats::addPhaseTime(const Phase phase, const double seconds)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    phaseSeconds[(size_t) phase] += seconds;
+}
+
+uint64_t Stats::getCounter(const Counter counter) const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    uint64_t total = 0;
+    for (const auto &slot : slots) {
+        total += slot.counters[(size_t) counter];
+    }
+    return total;
+}
+
+double Stats::getPhaseTime(const Phase phase) const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return phaseSeconds[(size_t) phase];
+}
+
+uint64_t Stats::getTotalRays() const
+{
+    return getCounter(Counter::PRIMARY_RAYS) + getCounter(Counter::REFLECTION_RAYS)
+        + getCounter(Counter::REFRACTION_RAYS) + getCounter(Counter::SHADOW_RAYS);
+}
+
+void Stats::reset()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    for (auto &slot : slots) {
+        slot.counters.fill(0);
+        slot.maxDepth = 0;
+    }
+    phaseSeconds.fill(0);
+}
+
+const char *Stats::getName(const Counter counter)
+{
+    switch (counter) {
+    case Counter::PRIMARY_RAYS: return "primary_rays";
+    case Counter::REFLECTION_RAYS: return "reflection_rays";
+    case Counter::REFRACTION_RAYS: return "refraction_rays";
+    case Counter::SHADOW_RAYS: return "shadow_rays";
+    case Counter::NODE_VISITS: return "node_visits";
+    case Counter::PRIMITIVE_TESTS: return "primitive_tests";
+    default: return "unknown";
+    }
+}
+
+const char *Stats::getName(const Phase phase)
+{
+    switch (phase) {
+    case Phase::SCENE_SETUP: return "scene_setup";
+    case Phase::ACCELERATION_BUILD: return "acceleration_build";
+    case Phase::RENDER: return "render";
+    case Phase::IMAGE_OUTPUT: return "image_output";
+    case Phase::BACKGROUND_OUTPUT: return "background_output";
+    case Phase::BATCH: return "batch";
+    default: return "unknown";
+    }
+}
+
+void Stats::print(std::ostream &out) const
+{
+    const auto flags = out.flags();
+    const auto precision = out.precision();
+    const double renderTime = getPhaseTime(Phase::RENDER);
+    out << "---------- Statistics ----------" << std::endl;
+    for (size_t i = 0; i < NUM_PHASES; i++) {
+        out << std::left << std::setw(20) << getName((Phase) i) << std::fixed << std::setprecision(3)
+            << getPhaseTime((Phase) i) << " s" << std::endl;
+    }
+    for (size_t i = 0; i < NUM_COUNTERS; i++) {
+        out << std::left << std::setw(20) << getName((Counter) i) << getCounter((Counter) i) << std::endl;
+    }
+    if (renderTime > 0) {
+        out << std::left << std::setw(20) << "rays_per_second" << std::setprecision(0)
+            << (double) getTotalRays() / renderTime << std::endl;
+    }
+    out.flags(flags);
+    out.precision(precision);
+}
+
+void Stats::writeJSON(const std::string &path) const
+{
+    std::ofstream file(path);
+    if (!file) {
+        std::cerr << "Cannot open " << path << std::endl;
+        return;
+    }
+
+    const double renderTime = getPhaseTime(Phase::RENDER);
+    file << "{\n  \"phases\": {";
+    for (size_t i = 0; i < NUM_PHASES; i++) {
+        file << (i ? ", " : "") << "\"" << getName((Phase) i) << "\": " << getPhaseTime((Phase) i);
+    }
+    file << "},\n  \"counters\": {";
+    for (size_t i = 0; i < NUM_COUNTERS; i++) {
+        file << (i ? ", " : "") << "\"" << getName((Counter) i) << "\": " << getCounter((Counter) i);
+    }
+    file << "},\n  \"total_rays\": " << getTotalRays() << ",\n";
+    file << "  \"rays_per_second\": " << (renderTime > 0 ? (double) getTotalRays() / renderTime : 0.0) << "\n}\n";
+}
+
+ScopedTimer::~ScopedTimer()
+{
+    const double seconds = elapsed();
+    Stats::get().addPhaseTime(phase, seconds - nested);
+    if (parent)
+        parent->nested += seconds;
+    current() = parent;
+}
+
+double ScopedTimer::elapsed() const
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
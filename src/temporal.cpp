@@ -0,0 +1,151 @@
+//
+// Created by michele on 19.10.26.
+//
+
+#include "temporal.h"
+#include "trace.h"
+#include <algorithm>
+#include <numeric>
+
+std::optional<std::vector<Box>> TemporalCache::updateSnapshots(const Scene &scene)
+{
+    std::vector<Box> changed;
+    bool emitterChanged = false;
+
+    const auto isEmitter = [&scene](const Object *object)
+    {
+        return std::any_of(scene.getLights().begin(), scene.getLights().end(),
+                           [object](const std::shared_ptr<Light> &light) { return light->getLightObject().get() == object; });
+    };
+
+    std::unordered_map<const Object *, Snapshot> current;
+    current.reserve(scene.getObjects().size());
+    for (const auto &object : scene.getObjects()) {
+        const Snapshot snapshot{object->getVersion(), object->getBoundingBox()};
+        current.emplace(object.get(), snapshot);
+
+        const auto previous = snapshots.find(object.get());
+        if (previous != snapshots.end() && previous->second.version == snapshot.version)
+            continue;
+
+        if (previous != snapshots.end())
+            changed.push_back(previous->second.bounds);
+        changed.push_back(snapshot.bounds);
+        emitterChanged |= isEmitter(object.get());
+    }
+    for (const auto &[object, snapshot] : snapshots) {
+        if (current.find(object) == current.end())
+            changed.push_back(snapshot.bounds);
+    }
+
+    snapshots = std::move(current);
+    if (emitterChanged)
+        return std::nullopt;
+    return changed;
+}
+
+bool TemporalCache::isAffected(const PixelFootprint &footprint, const Box &bounds, const Scene &scene) const
+{
+    if (footprint.secondary)
+        return true;
+    if (!footprint.hasHits())
+        return false;
+
+    // A shadow ray from any point of the footprint crosses the bounds only if the ray from its centre crosses the
+    // bounds grown by the half extent of the footprint
+    const glm::vec3 centre = (footprint.min + footprint.max) * 0.5f;
+    const glm::vec3 extent = (footprint.max - footprint.min) * 0.5f;
+    const Box grown(bounds.min - extent, bounds.max + extent);
+    for (const auto &light : scene.getLights()) {
+        const Box area = light->getBounds();
+        if (area.min == area.max) {
+            for (const glm::vec3 &sample : light->getSamples()) {
+                if (grown.intersectsSegment(centre, sample))
+                    return true;
+            }
+            continue;
+        }
+
+        // Lights may be sampled anywhere on their extent: likewise, the segment towards the centre of the light
+        // crosses the bounds grown by the half extent of the light too
+        const glm::vec3 reach = extent + (area.max - area.min) * 0.5f;
+        if (Box(bounds.min - reach, bounds.max + reach).intersectsSegment(centre, area.getCenter()))
+            return true;
+    }
+    return false;
+}
+
+std::vector<int> TemporalCache::update(const Scene &scene, const Camera &camera, const int width, const int height)
+{
+    TRACE_SCOPE("temporal_update");
+
+    const auto allTiles = [this]
+    {
+        std::vector<int> tiles(getTileCount());
+        std::iota(tiles.begin(), tiles.end(), 0);
+        return tiles;
+    };
+
+    const std::optional<std::vector<Box>> changed = updateSnapshots(scene);
+    if (!image || width != this->width || height != this->height) {
+        this->width = width;
+        this->height = height;
+        tilesX = (width + TILE_SIZE - 1) / TILE_SIZE;
+        tilesY = (height + TILE_SIZE - 1) / TILE_SIZE;
+        image.emplace(width, height);
+        footprints.assign(getTileCount(), PixelFootprint());
+        this->camera = camera;
+        return allTiles();
+    }
+    if (!changed || this->camera != camera) {
+        this->camera = camera;
+        return allTiles();
+    }
+
+    std::vector<char> dirty(tilesX * tilesY, 0);
+    for (const Box &bounds : *changed) {
+        const std::optional<std::array<int, 4>> rect = camera.project(bounds, width, height);
+        if (!rect)
+            return allTiles();
+        if ((*rect)[2] < 0 || (*rect)[3] < 0 || (*rect)[0] >= width || (*rect)[1] >= height)
+            continue;
+
+        const int minX = std::max((*rect)[0], 0) / TILE_SIZE;
+        const int minY = std::max((*rect)[1], 0) / TILE_SIZE;
+        const int maxX = std::min((*rect)[2], width - 1) / TILE_SIZE;
+        const int maxY = std::min((*rect)[3], height - 1) / TILE_SIZE;
+        for (int ty = minY; ty <= maxY; ty++) {
+            for (int tx = minX; tx <= maxX; tx++) {
+                dirty[ty * tilesX + tx] = 1;
+            }
+        }
+    }
+
+    if (!changed->empty()) {
+        #pragma omp parallel for schedule(dynamic, 1)
+        for (int tile = 0; tile < tilesX * tilesY; tile++) {
+            if (dirty[tile])
+                continue;
+            for (const Box &bounds : *changed) {
+                if (isAffected(footprints[tile], bounds, scene)) {
+                    dirty[tile] = 1;
+                    break;
+                }
+            }
+        }
+    }
+
+    std::vector<int> tiles;
+    for (int tile = 0; tile < tilesX * tilesY; tile++) {
+        if (dirty[tile])
+            tiles.push_back(tile);
+    }
+    return tiles;
+}
+
+std::array<int, 4> TemporalCache::getTile(const int tile) const
+{
+    const int x = (tile % tilesX) * TILE_SIZE;
+    const int y = (tile / tilesX) * TILE_SIZE;
+    return {x, y, std::min(x + TILE_SIZE, width), std::min(y + TILE_SIZE, height)};
+}
@@ -0,0 +1,63 @@
+//
+// Created by michele on 19.10.26.
+//
+
+#include "trace.h"
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+
+#if TRACE
+
+TraceRecorder &TraceRecorder::get()
+{
+    static TraceRecorder recorder;
+    return recorder;
+}
+
+TraceRecorder::ThreadBuffer &TraceRecorder::registerThread()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return buffers.emplace_back(ThreadBuffer{(int) buffers.size(), {}});
+}
+
+void TraceRecorder::write(const std::string &path)
+{
+    std::ofstream file(path);
+    if (!file) {
+        std::cerr << "Cannot open " << path << std::endl;
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    file << std::fixed << std::setprecision(3);
+    file << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n";
+    bool first = true;
+    for (const auto &buffer : buffers) {
+        file << (first ? "" : ",\n") << R"({"name": "thread_name", "ph": "M", "pid": 1, "tid": )" << buffer.tid
+             << R"(, "args": {"name": "worker )" << buffer.tid << "\"}}";
+        first = false;
+        for (const auto &event : buffer.events) {
+            file << ",\n{\"name\": \"" << event.name << R"(", "ph": "X", "pid": 1, "tid": )" << buffer.tid
+                 << ", \"ts\": " << (double) event.start / 1000.0 << ", \"dur\": " << (double) event.duration / 1000.0;
+            if (event.arg != NO_ARG)
+                file << ", \"args\": {\"value\": " << event.arg << "}";
+            file << "}";
+        }
+    }
+    file << "\n]}\n";
+}
+
+void writeTrace(const std::string &path)
+{
+    TraceRecorder::get().write(path);
+}
+
+#else
+
+void writeTrace(const std::string &path)
+{
+    std::cerr << "Tracing is disabled, rebuild with TRACE=1 to write " << path << std::endl;
+}
+
+#endif
@@ -4,6 +4,10 @@
 
 #include "tracers/kdtree.h"
 #include "objects/plane.h"
+#include "stats.h"
+#include "trace.h"
+#include <algorithm>
+#include <chrono>
 #include <iostream>
 #include <numeric>
 #include <stdexcept>
@@ -19,6 +23,7 @@ std::optional<Hit> KDTreeTracer::traverse(const Ray &ray,
         throw std::runtime_error("Node index out of bounds");
     }
 
+    Stats::increment(Counter::NODE_VISITS);
     const auto &node = nodes[currentNodeIdx];
     if (node.isLeaf()) {
         if (node.getNumObjects() == 1) {
@@ -26,6 +31,7 @@ std::optional<Hit> KDTreeTracer::traverse(const Ray &ray,
             if (!object->getBoundingBox().intersect(ray)) {
                 return std::nullopt;
             }
+            Stats::increment(Counter::PRIMITIVE_TESTS);
             return object->intersect(ray);
         }
 
@@ -35,6 +41,7 @@ std::optional<Hit> KDTreeTracer::traverse(const Ray &ray,
             if (!object->getBoundingBox().intersect(ray)) {
                 continue;
             }
+            Stats::increment(Counter::PRIMITIVE_TESTS);
             auto hit = object->intersect(ray);
             if (hit && (!closestHit || hit->distance < closestHit->distance)) {
                 closestHit = hit;
@@ -72,17 +79,176 @@ std::optional<Hit> KDTreeTracer::trace(const Ray &ray) const
     return traverse(ray, 0, 0, std::numeric_limits<float>::max());
 }
 
+void KDTreeTracer::traceShadows(const ShadowBatch &batch, std::vector<bool> &occluded) const
+{
+    ShadowRays rays(batch, occluded);
+    Stats::increment(Counter::SHADOW_RAYS, batch.targets.size());
+    if (nodes.empty())
+        return;
+
+    thread_local std::vector<ShadowSpan> spans;
+    spans.clear();
+    for (size_t r = 0; r < batch.targets.size(); r++)
+        spans.push_back({(int) r, 0.0f, rays.lengths[r]});
+    traverseShadows(rays, 0, spans, 0, spans.size());
+}
+
+void KDTreeTracer::traverseShadows(ShadowRays &rays, const int nodeIndex, std::vector<ShadowSpan> &spans,
+                                   const size_t begin, const size_t end) const
+{
+    Stats::increment(Counter::NODE_VISITS);
+    const auto &node = nodes[nodeIndex];
+    if (node.isLeaf()) {
+        thread_local std::vector<int> indices;
+        indices.clear();
+        for (size_t s = begin; s < end; s++) {
+            if (!rays.occluded[spans[s].ray])
+                indices.push_back(spans[s].ray);
+        }
+        if (indices.empty())
+            return;
+
+        if (node.getNumObjects() == 1) {
+            testShadows(rays, *objects[node.getSingleObject()], indices.data(), indices.size());
+            return;
+        }
+        for (const auto &objectIndex : leafObjectIndices[node.getObjectsOffset()])
+            testShadows(rays, *objects[objectIndex], indices.data(), indices.size());
+        return;
+    }
+
+    const int axis = node.getAxis();
+    const float split = node.getSplit();
+    const int left = nodeIndex + 1;
+    const int right = node.getChild();
+
+    // All the segments on one side of the split: the spans go down unchanged
+    if (rays.bounds.max[axis] < split) {
+        traverseShadows(rays, left, spans, begin, end);
+        return;
+    }
+    if (rays.bounds.min[axis] > split) {
+        traverseShadows(rays, right, spans, begin, end);
+        return;
+    }
+
+    // Shared by every ray of the batch: how far the split is from the origin, and on which side the origin lies
+    const float offset = split - rays.batch.origin[axis];
+    for (int pass = 0; pass < 2; pass++) {
+        // The side of the origin first, where the blockers are met first
+        const bool lower = (pass == 0) == (offset >= 0);
+        const size_t first = spans.size();
+        for (size_t s = begin; s < end; s++) {
+            const ShadowSpan span = spans[s];
+            if (rays.occluded[span.ray])
+                continue;
+
+            const float direction = rays.directions[span.ray][axis];
+            if (offset == 0 || direction == 0 || (offset > 0) != (direction > 0)) {
+                // Not crossing the split: the span stays on the side of the origin, or on the side it heads to when
+                // the origin lies on the split
+                const bool below = offset > 0 || (offset == 0 && direction <= 0);
+                const bool above = offset < 0 || (offset == 0 && direction >= 0);
+                if (lower ? below : above)
+                    spans.push_back(span);
+                continue;
+            }
+
+            const float tsplit = offset * rays.inverses[span.ray][axis];
+            const bool beforeSplit = lower == (offset > 0);
+            if (beforeSplit && span.tmin <= tsplit)
+                spans.push_back({span.ray, span.tmin, std::min(span.tmax, tsplit)});
+            else if (!beforeSplit && tsplit <= span.tmax)
+                spans.push_back({span.ray, std::max(span.tmin, tsplit), span.tmax});
+        }
+        if (spans.size() > first)
+            traverseShadows(rays, lower ? left : right, spans, first, spans.size());
+        spans.resize(first);
+    }
+}
 
 KDTreeTracer::KDTreeTracer(std::vector<std::shared_ptr<Object>> &_objects)
     : Tracer(_objects)
 {
+    TRACE_SCOPE("kdtree_build", (int) objects.size());
     std::vector<int> idxs(objects.size());
     std::iota(idxs.begin(), idxs.end(), 0);
 
-    const auto startTime = clock();
+    const auto startTime = std::chrono::steady_clock::now();
     construct(0, 0, std::move(idxs));
-    const auto endTime = clock();
-    std::cout << "KDTree construction time: " << (endTime - startTime) / (double) CLOCKS_PER_SEC << "s" << std::endl;
+    const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - startTime;
+    std::cout << "KDTree construction time: " << elapsed.count() << "s" << std::endl;
+}
+
+static double surfaceArea(const Box &box)
+{
+    const glm::vec3 extent = box.max - box.min;
+    return 2.0 * ((double) extent.x * extent.y + (double) extent.y * extent.z + (double) extent.z * extent.x);
+}
+
+TracerStats KDTreeTracer::getStats() const
+{
+    TracerStats stats;
+    stats.name = "KDTreeTracer";
+    stats.objects = objects.size();
+    stats.nodeBytes = nodes.capacity() * sizeof(KDTreeNode);
+    stats.indexBytes = leafObjectIndices.capacity() * sizeof(std::vector<int>);
+    for (const auto &indices : leafObjectIndices) {
+        stats.indexBytes += indices.capacity() * sizeof(int);
+    }
+    if (nodes.empty())
+        return stats;
+
+    // Infinite objects (e.g. planes) would make every area infinite: the SAH is computed within the finite ones.
+    const float limit = std::numeric_limits<float>::max();
+    std::optional<Box> bounds;
+    for (const auto &object : objects) {
+        const Box &box = object->getBoundingBox();
+        if (box.min.x > -limit && box.min.y > -limit && box.min.z > -limit
+            && box.max.x < limit && box.max.y < limit && box.max.z < limit) {
+            if (bounds)
+                bounds->merge(box);
+            else
+                bounds = box;
+        }
+    }
+    const double rootArea = bounds ? surfaceArea(*bounds) : 0;
+
+    collectStats(0, 0, bounds.value_or(Box(glm::vec3(-limit), glm::vec3(limit))), rootArea, stats);
+    if (stats.leaves > 0)
+        stats.averageDepth /= (double) stats.leaves;
+    return stats;
+}
+
+void KDTreeTracer::collectStats(const int nodeIndex, const int depth, const Box &bounds, const double rootArea,
+                                TracerStats &stats) const
+{
+    const auto &node = nodes[nodeIndex];
+    const double relativeArea = rootArea > 0 ? surfaceArea(bounds) / rootArea : 1.0;
+    stats.nodes++;
+
+    if (node.isLeaf()) {
+        const size_t count = node.getNumObjects();
+        stats.leaves++;
+        stats.maxDepth = std::max(stats.maxDepth, depth);
+        stats.averageDepth += depth;
+        stats.occupancy[count]++;
+        stats.references += count;
+        stats.sahCost += TracerStats::SAH_INTERSECTION_COST * (double) count * relativeArea;
+        return;
+    }
+
+    stats.sahCost += TracerStats::SAH_TRAVERSAL_COST * relativeArea;
+
+    const int axis = node.getAxis();
+    const float split = glm::clamp(node.getSplit(), bounds.min[axis], bounds.max[axis]);
+    Box left = bounds;
+    Box right = bounds;
+    left.max[axis] = split;
+    right.min[axis] = split;
+
+    collectStats(nodeIndex + 1, depth + 1, left, rootArea, stats);
+    collectStats(node.getChild(), depth + 1, right, rootArea, stats);
 }
 
 void KDTreeTracer::construct(const int nodeIndex, const int depth, std::vector<int> obj_indices)
@@ -3,6 +3,8 @@
 //
 
 #include "tracers/naive.h"
+#include "stats.h"
+
 std::optional<Hit> NaiveTracer::trace(const Ray &ray) const
 {
     std::optional<Hit> closestHit;
@@ -10,6 +12,7 @@ std::optional<Hit> NaiveTracer::trace(const Ray &ray) const
         if (!object->getBoundingBox().intersect(ray)) {
             continue;
         }
+        Stats::increment(Counter::PRIMITIVE_TESTS);
         auto hit = object->intersect(ray);
         if (hit && (!closestHit || hit->distance < closestHit->distance)) {
             closestHit = hit;
@@ -17,3 +20,10 @@ std::optional<Hit> NaiveTracer::trace(const Ray &ray) const
     }
     return closestHit;
 }
+
+TracerStats NaiveTracer::getStats() const
+{
+    TracerStats stats = Tracer::getStats();
+    stats.name = "NaiveTracer";
+    return stats;
+}
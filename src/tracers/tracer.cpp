@@ -3,6 +3,12 @@
 //
 
 #include "tracers/tracer.h"
+#include "stats.h"
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
 Tracer::Tracer() : objects() {}
 
 Tracer::Tracer(std::vector<std::shared_ptr<Object>> &objects) : objects(std::move(objects))
@@ -12,3 +18,129 @@ std::vector<std::shared_ptr<Object>> &Tracer::getObjects()
 {
     return objects;
 }
+
+Tracer::ShadowRays::ShadowRays(const ShadowBatch &batch, std::vector<bool> &occluded)
+    : batch(batch), bounds(batch.origin, batch.origin), occluded(occluded)
+{
+    directions.reserve(batch.targets.size());
+    inverses.reserve(batch.targets.size());
+    lengths.reserve(batch.targets.size());
+    for (const glm::vec3 &target : batch.targets) {
+        const glm::vec3 offset = target - batch.origin;
+        const float length = glm::length(offset);
+        directions.push_back(offset / length);
+        inverses.push_back(1.0f / directions.back());
+        lengths.push_back(length);
+        bounds.merge(Box(target, target));
+    }
+    occluded.assign(batch.targets.size(), false);
+}
+
+void Tracer::testShadows(ShadowRays &rays, Object &object, const int *indices, const size_t count)
+{
+    const Box &box = object.getBoundingBox();
+    for (int axis = 0; axis < 3; axis++) {
+        if (box.max[axis] < rays.bounds.min[axis] || box.min[axis] > rays.bounds.max[axis])
+            return;
+    }
+
+    const glm::vec3 &origin = rays.batch.origin;
+    const glm::vec3 toMin = box.min - origin;
+    const glm::vec3 toMax = box.max - origin;
+    for (size_t k = 0; k < count; k++) {
+        const int r = indices[k];
+        if (rays.occluded[r])
+            continue;
+
+        const glm::vec3 t0 = toMin * rays.inverses[r];
+        const glm::vec3 t1 = toMax * rays.inverses[r];
+        const glm::vec3 tmin = glm::min(t0, t1);
+        const glm::vec3 tmax = glm::max(t0, t1);
+        const float tNear = glm::max(glm::max(tmin.x, tmin.y), tmin.z);
+        const float tFar = glm::min(glm::min(tmax.x, tmax.y), tmax.z);
+        if (tNear > tFar || tFar < 0 || tNear > rays.lengths[r])
+            continue;
+
+        Stats::increment(Counter::PRIMITIVE_TESTS);
+        const std::optional<Hit> hit = object.intersect(Ray(origin, rays.directions[r]));
+        if (!hit || glm::distance(hit->intersection, origin) >= rays.lengths[r])
+            continue;
+        rays.occluded[r] = hit->object != rays.batch.light
+            || glm::distance(hit->intersection, rays.batch.targets[r]) > 1e-3f * rays.lengths[r];
+    }
+}
+
+void Tracer::traceShadows(const ShadowBatch &batch, std::vector<bool> &occluded) const
+{
+    ShadowRays rays(batch, occluded);
+    Stats::increment(Counter::SHADOW_RAYS, batch.targets.size());
+
+    std::vector<int> indices(batch.targets.size());
+    for (size_t r = 0; r < indices.size(); r++)
+        indices[r] = (int) r;
+    for (const auto &object : objects)
+        testShadows(rays, *object, indices.data(), indices.size());
+}
+
+TracerStats Tracer::getStats() const
+{
+    TracerStats stats;
+    stats.name = "Tracer";
+    stats.objects = objects.size();
+    stats.nodes = 1;
+    stats.leaves = 1;
+    stats.averageDepth = 0;
+    stats.occupancy[objects.size()] = 1;
+    stats.references = objects.size();
+    stats.sahCost = TracerStats::SAH_INTERSECTION_COST * (double) objects.size();
+    stats.indexBytes = objects.capacity() * sizeof(std::shared_ptr<Object>);
+    return stats;
+}
+
+double TracerStats::getDuplicationFactor() const
+{
+    return objects == 0 ? 0 : (double) references / (double) objects;
+}
+
+void TracerStats::print(std::ostream &out) const
+{
+    const auto flags = out.flags();
+    const auto precision = out.precision();
+    out << name << ": " << objects << " objects, " << nodes << " nodes, " << leaves << " leaves" << std::endl;
+    out << "  depth max " << maxDepth << ", avg " << std::fixed << std::setprecision(2) << averageDepth
+        << "; duplication " << getDuplicationFactor() << "; SAH cost " << sahCost << std::endl;
+    out << "  memory " << nodeBytes << " B nodes, " << indexBytes << " B leaf indices" << std::endl;
+    out << "  leaf occupancy:";
+    for (const auto &[count, leafCount] : occupancy) {
+        out << " " << count << "x" << leafCount;
+    }
+    out << std::endl;
+    out.flags(flags);
+    out.precision(precision);
+}
+
+std::string TracerStats::toJSON() const
+{
+    std::ostringstream json;
+    json << "{\"name\": \"" << name << "\", \"objects\": " << objects << ", \"nodes\": " << nodes
+         << ", \"leaves\": " << leaves << ", \"max_depth\": " << maxDepth << ", \"average_depth\": " << averageDepth
+         << ", \"duplication_factor\": " << getDuplicationFactor() << ", \"sah_cost\": " << sahCost
+         << ", \"node_bytes\": " << nodeBytes << ", \"index_bytes\": " << indexBytes << ", \"leaf_occupancy\": {";
+    bool first = true;
+    for (const auto &[count, leafCount] : occupancy) {
+        json << (first ? "" : ", ") << "\"" << count << "\": " << leafCount;
+        first = false;
+    }
+    json << "}}";
+    return json.str();
+}
+
+void TracerStats::writeJSON(const std::string &path) const
+{
+    std::ofstream file(path);
+    if (!file) {
+        std::cerr << "Cannot open " << path << std::endl;
+        return;
+    }
+    file << toJSON() << std::endl;
+}
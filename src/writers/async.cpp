@@ -0,0 +1,64 @@
+//
+// Created by michele on 19.10.26.
+//
+
+#include "writers/async.h"
+#include "stats.h"
+#include <algorithm>
+
+AsyncImageWriter::AsyncImageWriter(const size_t maxQueued)
+    : maxQueued(std::max<size_t>(maxQueued, 1)), thread(&AsyncImageWriter::run, this)
+{
+}
+
+AsyncImageWriter::~AsyncImageWriter()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wakeUp.notify_one();
+    thread.join();
+}
+
+void AsyncImageWriter::submit(Image image, std::string path, const ToneMapping toneMapping)
+{
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        idle.wait(lock, [this] { return queue.size() < maxQueued; });
+        queue.push_back({std::move(image), std::move(path), toneMapping});
+    }
+    wakeUp.notify_one();
+}
+
+void AsyncImageWriter::wait()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    idle.wait(lock, [this] { return queue.empty() && !busy; });
+}
+
+void AsyncImageWriter::run()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        wakeUp.wait(lock, [this] { return stopping || !queue.empty(); });
+        if (queue.empty())
+            return;
+
+        Job job = std::move(queue.front());
+        queue.pop_front();
+        busy = true;
+        lock.unlock();
+        idle.notify_all();
+
+        {
+            ScopedTimer timer(Phase::BACKGROUND_OUTPUT);
+            job.image.writeImage(job.path, job.toneMapping);
+        }
+
+        lock.lock();
+        busy = false;
+        if (queue.empty())
+            idle.notify_all();
+    }
+}
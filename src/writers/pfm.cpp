@@ -0,0 +1,60 @@
+//
+// Created by michele on 19.10.26.
+//
+
+#include "writers/pfm.h"
+#include <algorithm>
+
+void PFMWriter::open(std::ostream &stream, const int _width, const int _height)
+{
+    ImageWriter::open(stream, _width, _height);
+    // a negative scale marks little-endian data, the byte order of every platform we build on
+    *out << "PF\n" << width << " " << height << "\n-1.0\n";
+    dataOffset = out->tellp();
+    nextRow = 0;
+}
+
+void PFMWriter::pack(const glm::vec3 *pixels, const int count)
+{
+    const size_t rowFloats = (size_t) width * 3;
+    buffer.resize(rowFloats * count);
+    for (int r = 0; r < count; r++) {
+        float *row = buffer.data() + (size_t) (count - 1 - r) * rowFloats;
+        for (int x = 0; x < width; x++) {
+            const glm::vec3 &pixel = pixels[(size_t) r * width + x];
+            row[3 * x] = pixel.r;
+            row[3 * x + 1] = pixel.g;
+            row[3 * x + 2] = pixel.b;
+        }
+    }
+}
+
+void PFMWriter::writeRows(const glm::vec3 *pixels, const int count)
+{
+    // PFM stores the rows from bottom to top: the block is reversed and written at its final offset
+    const size_t rowFloats = (size_t) width * 3;
+    pack(pixels, count);
+    out->seekp(dataOffset + (std::streamoff) ((height - nextRow - count) * rowFloats * sizeof(float)));
+    out->write((const char *) buffer.data(), (std::streamsize) (buffer.size() * sizeof(float)));
+    nextRow += count;
+}
+
+void PFMWriter::writeBlocks(const Image &image)
+{
+    // With the whole image at hand the blocks are resolved from the bottom, so that no seek is needed
+    const int blockRows = getBlockRows();
+    std::vector<glm::vec3> rows((size_t) blockRows * width);
+    for (int end = height; end > 0; end -= blockRows) {
+        const int count = std::min(blockRows, end);
+        image.resolveRows(end - count, count, rows.data());
+        pack(rows.data(), count);
+        out->write((const char *) buffer.data(), (std::streamsize) (buffer.size() * sizeof(float)));
+        nextRow += count;
+    }
+    close();
+}
+
+std::streamoff PFMWriter::getEncodedSize() const
+{
+    return dataOffset + (std::streamoff) ((size_t) width * height * 3 * sizeof(float));
+}
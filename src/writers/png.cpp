@@ -0,0 +1,373 @@
+//
+// Created by michele on 19.10.26.
+//
+
+#include "writers/png.h"
+#include <algorithm>
+#include <array>
+#include <cstdlib>
+#include <omp.h>
+
+namespace {
+
+constexpr uint32_t ADLER_BASE = 65521;
+
+constexpr int WINDOW_SIZE = 32768;
+constexpr int HASH_BITS = 15;
+constexpr int MIN_MATCH = 3;
+constexpr int MAX_MATCH = 258;
+constexpr int MAX_CHAIN = 32;///< candidates examined per position, trading ratio for speed
+
+constexpr std::array<int, 29> LENGTH_BASE = {3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59,
+                                             67, 83, 99, 115, 131, 163, 195, 227, 258};
+constexpr std::array<int, 29> LENGTH_EXTRA = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3,
+                                              4, 4, 4, 4, 5, 5, 5, 5, 0};
+constexpr std::array<int, 30> DISTANCE_BASE = {1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385,
+                                               513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577};
+constexpr std::array<int, 30> DISTANCE_EXTRA = {0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7,
+                                                8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+
+/**
+ * Deflate bit stream, filled from the least significant bit of each byte.
+ */
+class BitWriter
+{
+private:
+    std::vector<uint8_t> &out;
+    uint32_t buffer = 0;
+    int count = 0;
+
+public:
+    explicit BitWriter(std::vector<uint8_t> &out) : out(out) {}
+
+    void write(const uint32_t bits, const int n)
+    {
+        buffer |= bits << count;
+        count += n;
+        while (count >= 8) {
+            out.push_back((uint8_t) buffer);
+            buffer >>= 8;
+            count -= 8;
+        }
+    }
+
+    /**
+     * Huffman codes are defined from their most significant bit, so they are written reversed.
+     */
+    void writeCode(const uint32_t code, const int n)
+    {
+        uint32_t reversed = 0;
+        for (int i = 0; i < n; i++) {
+            reversed |= ((code >> i) & 1) << (n - 1 - i);
+        }
+        write(reversed, n);
+    }
+
+    void align()
+    {
+        if (count > 0)
+            write(0, 8 - count);
+    }
+};
+
+void writeLiteralLength(BitWriter &bits, const int symbol)
+{
+    if (symbol <= 143)
+        bits.writeCode(0x30 + symbol, 8);
+    else if (symbol <= 255)
+        bits.writeCode(0x190 + symbol - 144, 9);
+    else if (symbol <= 279)
+        bits.writeCode(symbol - 256, 7);
+    else
+        bits.writeCode(0xC0 + symbol - 280, 8);
+}
+
+void writeMatch(BitWriter &bits, const int length, const int distance)
+{
+    const int lengthCode = (int) (std::upper_bound(LENGTH_BASE.begin(), LENGTH_BASE.end(), length) - LENGTH_BASE.begin()) - 1;
+    writeLiteralLength(bits, 257 + lengthCode);
+    bits.write(length - LENGTH_BASE[lengthCode], LENGTH_EXTRA[lengthCode]);
+
+    const int distanceCode = (int) (std::upper_bound(DISTANCE_BASE.begin(), DISTANCE_BASE.end(), distance) - DISTANCE_BASE.begin()) - 1;
+    bits.writeCode(distanceCode, 5);
+    bits.write(distance - DISTANCE_BASE[distanceCode], DISTANCE_EXTRA[distanceCode]);
+}
+
+uint32_t hash(const uint8_t *p)
+{
+    return (((uint32_t) p[0] << 10) ^ ((uint32_t) p[1] << 5) ^ p[2]) & ((1u << HASH_BITS) - 1);
+}
+
+uint8_t paeth(const int a, const int b, const int c)
+{
+    const int p = a + b - c;
+    const int pa = std::abs(p - a);
+    const int pb = std::abs(p - b);
+    const int pc = std::abs(p - c);
+    if (pa <= pb && pa <= pc)
+        return (uint8_t) a;
+    return (uint8_t) (pb <= pc ? b : c);
+}
+
+void putBigEndian(uint8_t *out, const uint32_t value)
+{
+    out[0] = (uint8_t) (value >> 24);
+    out[1] = (uint8_t) (value >> 16);
+    out[2] = (uint8_t) (value >> 8);
+    out[3] = (uint8_t) value;
+}
+
+}// namespace
+
+uint32_t PNGWriter::crc32(uint32_t crc, const uint8_t *data, const size_t size)
+{
+    static const std::array<uint32_t, 256> table = []
+    {
+        std::array<uint32_t, 256> t{};
+        for (uint32_t n = 0; n < 256; n++) {
+            uint32_t c = n;
+            for (int k = 0; k < 8; k++) {
+                c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            }
+            t[n] = c;
+        }
+        return t;
+    }();
+
+    crc = ~crc;
+    for (size_t i = 0; i < size; i++) {
+        crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+uint32_t PNGWriter::adler32(const uint32_t adler, const uint8_t *data, size_t size)
+{
+    uint32_t a = adler & 0xFFFF;
+    uint32_t b = adler >> 16;
+    while (size > 0) {
+        // 5552 is the largest n for which the sums cannot overflow before the modulo
+        const size_t n = std::min(size, (size_t) 5552);
+        for (size_t i = 0; i < n; i++) {
+            a += data[i];
+            b += a;
+        }
+        a %= ADLER_BASE;
+        b %= ADLER_BASE;
+        data += n;
+        size -= n;
+    }
+    return (b << 16) | a;
+}
+
+uint32_t PNGWriter::adler32Combine(const uint32_t first, const uint32_t second, const size_t secondLength)
+{
+    const uint32_t remainder = (uint32_t) (secondLength % ADLER_BASE);
+    uint32_t a = first & 0xFFFF;
+    uint32_t b = (uint32_t) (((uint64_t) remainder * a) % ADLER_BASE);
+    a += (second & 0xFFFF) + ADLER_BASE - 1;
+    b += (first >> 16) + (second >> 16) + ADLER_BASE - remainder;
+    if (a >= ADLER_BASE)
+        a -= ADLER_BASE;
+    if (a >= ADLER_BASE)
+        a -= ADLER_BASE;
+    if (b >= 2 * ADLER_BASE)
+        b -= 2 * ADLER_BASE;
+    if (b >= ADLER_BASE)
+        b -= ADLER_BASE;
+    return (b << 16) | a;
+}
+
+PNGWriter::Strip PNGWriter::compress(const uint8_t *data, const size_t size)
+{
+    Strip strip;
+    strip.length = size;
+    strip.adler = adler32(1, data, size);
+    strip.bytes.reserve(size / 2 + 16);
+
+    BitWriter bits(strip.bytes);
+    bits.write(0, 1);// not the final block
+    bits.write(1, 2);// fixed Huffman codes
+
+    std::vector<int> head((size_t) 1 << HASH_BITS, -1);
+    std::vector<int> previous(size);
+    const auto insert = [&](const size_t position)
+    {
+        if (position + MIN_MATCH <= size) {
+            const uint32_t h = hash(data + position);
+            previous[position] = head[h];
+            head[h] = (int) position;
+        }
+    };
+
+    size_t position = 0;
+    while (position < size) {
+        int bestLength = 0;
+        int bestDistance = 0;
+        if (position + MIN_MATCH <= size) {
+            const int maxLength = (int) std::min((size_t) MAX_MATCH, size - position);
+            int candidate = head[hash(data + position)];
+            for (int chain = 0; candidate >= 0 && (int) position - candidate <= WINDOW_SIZE && chain < MAX_CHAIN; chain++) {
+                int length = 0;
+                while (length < maxLength && data[candidate + length] == data[position + length]) {
+                    length++;
+                }
+                if (length > bestLength) {
+                    bestLength = length;
+                    bestDistance = (int) position - candidate;
+                    if (length == maxLength)
+                        break;
+                }
+                candidate = previous[candidate];
+            }
+        }
+
+        if (bestLength >= MIN_MATCH) {
+            writeMatch(bits, bestLength, bestDistance);
+            for (int i = 0; i < bestLength; i++) {
+                insert(position + i);
+            }
+            position += bestLength;
+        } else {
+            writeLiteralLength(bits, data[position]);
+            insert(position);
+            position++;
+        }
+    }
+
+    writeLiteralLength(bits, 256);// end of block
+    // sync flush: an empty stored block brings the stream to a byte boundary, so strips can be concatenated
+    bits.write(0, 3);
+    bits.align();
+    bits.write(0x0000, 16);
+    bits.write(0xFFFF, 16);
+    return strip;
+}
+
+void PNGWriter::writeChunk(const char *type, const uint8_t *data, const size_t size)
+{
+    uint8_t header[8];
+    putBigEndian(header, (uint32_t) size);
+    std::copy(type, type + 4, header + 4);
+    out->write((const char *) header, sizeof(header));
+    out->write((const char *) data, (std::streamsize) size);
+
+    uint8_t crc[4];
+    putBigEndian(crc, crc32(crc32(0, header + 4, 4), data, size));
+    out->write((const char *) crc, sizeof(crc));
+}
+
+void PNGWriter::open(std::ostream &stream, const int _width, const int _height)
+{
+    ImageWriter::open(stream, _width, _height);
+    previousRow.clear();
+    adler = 1;
+    firstData = true;
+
+    static const uint8_t signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+    out->write((const char *) signature, sizeof(signature));
+
+    uint8_t header[13];
+    putBigEndian(header, width);
+    putBigEndian(header + 4, height);
+    header[8] = 8; // bit depth
+    header[9] = 2; // color type: RGB
+    header[10] = 0;// deflate
+    header[11] = 0;// adaptive filtering
+    header[12] = 0;// no interlace
+    writeChunk("IHDR", header, sizeof(header));
+}
+
+void PNGWriter::filterRow(const uint8_t *row, const uint8_t *previous, uint8_t *out) const
+{
+    const int bytes = 3 * width;
+    uint64_t bestCost = UINT64_MAX;
+    std::vector<uint8_t> candidate(bytes);
+
+    for (uint8_t filter = 0; filter < 5; filter++) {
+        if (!previous && filter >= 2)
+            break;
+        uint64_t cost = 0;
+        for (int i = 0; i < bytes; i++) {
+            const int left = i >= 3 ? row[i - 3] : 0;
+            const int up = previous ? previous[i] : 0;
+            const int upLeft = previous && i >= 3 ? previous[i - 3] : 0;
+            uint8_t predicted = 0;
+            switch (filter) {
+            case 1: predicted = (uint8_t) left; break;
+            case 2: predicted = (uint8_t) up; break;
+            case 3: predicted = (uint8_t) ((left + up) / 2); break;
+            case 4: predicted = paeth(left, up, upLeft); break;
+            default: break;
+            }
+            candidate[i] = (uint8_t) (row[i] - predicted);
+            cost += (uint64_t) std::abs((int8_t) candidate[i]);
+        }
+        if (cost < bestCost) {
+            bestCost = cost;
+            out[0] = filter;
+            std::copy(candidate.begin(), candidate.end(), out + 1);
+        }
+    }
+}
+
+void PNGWriter::writeRows(const glm::vec3 *pixels, const int count)
+{
+    const size_t rowBytes = (size_t) 3 * width;
+    const size_t filteredBytes = rowBytes + 1;
+
+    const int numStrips = (count + STRIP_ROWS - 1) / STRIP_ROWS;
+    std::vector<uint8_t> quantized(rowBytes * count);
+    std::vector<uint8_t> filtered(filteredBytes * count);
+    std::vector<Strip> strips(numStrips);
+
+    // the rows must all be quantised before filtering, since the first row of a strip looks at the one above it
+    #pragma omp parallel for schedule(static) num_threads(omp_get_max_threads())
+    for (int r = 0; r < count; r++) {
+        quantize(pixels + (size_t) r * width, width, toneMapping, &quantized[rowBytes * r]);
+    }
+
+    #pragma omp parallel for schedule(dynamic, 1) num_threads(omp_get_max_threads())
+    for (int s = 0; s < numStrips; s++) {
+        const int first = s * STRIP_ROWS;
+        const int last = std::min(count, first + STRIP_ROWS);
+        for (int r = first; r < last; r++) {
+            const uint8_t *above = r > 0 ? &quantized[rowBytes * (r - 1)]
+                                         : (previousRow.empty() ? nullptr : previousRow.data());
+            filterRow(&quantized[rowBytes * r], above, &filtered[filteredBytes * r]);
+        }
+        strips[s] = compress(&filtered[filteredBytes * first], filteredBytes * (last - first));
+    }
+
+    previousRow.assign(quantized.end() - (std::ptrdiff_t) rowBytes, quantized.end());
+
+    std::vector<uint8_t> data;
+    if (firstData) {
+        // zlib header: deflate with a 32K window, no dictionary, check bits making it a multiple of 31
+        data.push_back(0x78);
+        data.push_back(0x01);
+        firstData = false;
+    }
+    for (const Strip &strip : strips) {
+        data.insert(data.end(), strip.bytes.begin(), strip.bytes.end());
+        adler = adler32Combine(adler, strip.adler, strip.length);
+    }
+    writeChunk("IDAT", data.data(), data.size());
+}
+
+void PNGWriter::close()
+{
+    std::vector<uint8_t> data;
+    if (firstData) {
+        data.push_back(0x78);
+        data.push_back(0x01);
+    }
+    // final fixed Huffman block holding only the end-of-block code, then the Adler-32 of the stream
+    data.push_back(0x03);
+    data.push_back(0x00);
+    data.resize(data.size() + 4);
+    putBigEndian(&data[data.size() - 4], adler);
+    writeChunk("IDAT", data.data(), data.size());
+    writeChunk("IEND", nullptr, 0);
+    ImageWriter::close();
+}
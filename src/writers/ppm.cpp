@@ -0,0 +1,19 @@
+//
+// Created by michele on 19.10.26.
+//
+
+#include "writers/ppm.h"
+
+void PPMWriter::open(std::ostream &stream, const int _width, const int _height)
+{
+    ImageWriter::open(stream, _width, _height);
+    *out << "P6\n" << width << " " << height << "\n255\n";
+}
+
+void PPMWriter::writeRows(const glm::vec3 *pixels, const int count)
+{
+    const size_t size = (size_t) count * width;
+    buffer.resize(3 * size);
+    quantize(pixels, size, toneMapping, buffer.data());
+    out->write((const char *) buffer.data(), (std::streamsize) buffer.size());
+}
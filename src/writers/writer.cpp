@@ -0,0 +1,93 @@
+//
+// Created by michele on 19.10.26.
+//
+
+#include "writers/writer.h"
+#include "trace.h"
+#include "writers/pfm.h"
+#include "writers/png.h"
+#include "writers/ppm.h"
+#include <algorithm>
+#include <iostream>
+
+void ImageWriter::open(const std::string &path, const int _width, const int _height)
+{
+    file.open(path, std::ios::out | std::ios::binary | std::ios::trunc);
+    if (!file) {
+        std::cerr << "Cannot open " << path << std::endl;
+    }
+    open(file, _width, _height);
+}
+
+void ImageWriter::open(std::ostream &stream, const int _width, const int _height)
+{
+    out = &stream;
+    width = _width;
+    height = _height;
+}
+
+void ImageWriter::close()
+{
+    out->flush();
+    if (file.is_open())
+        file.close();
+}
+
+void ImageWriter::write(const Image &image, const std::string &path)
+{
+    TRACE_SCOPE("write_image");
+    open(path, image.getWidth(), image.getHeight());
+    writeBlocks(image);
+}
+
+void ImageWriter::write(const Image &image, std::ostream &stream)
+{
+    TRACE_SCOPE("write_image");
+    open(stream, image.getWidth(), image.getHeight());
+    writeBlocks(image);
+}
+
+void ImageWriter::writeBlocks(const Image &image)
+{
+    const int blockRows = getBlockRows();
+    std::vector<glm::vec3> rows((size_t) blockRows * image.getWidth());
+    for (int y = 0; y < image.getHeight(); y += blockRows) {
+        const int count = std::min(blockRows, image.getHeight() - y);
+        image.resolveRows(y, count, rows.data());
+        writeRows(rows.data(), count);
+    }
+    close();
+}
+
+void ImageWriter::quantize(const glm::vec3 *pixels, const size_t count, const ToneMapping toneMapping,
+                           unsigned char *out)
+{
+    for (size_t i = 0; i < count; i++) {
+        const glm::vec3 color = 255.0f * glm::clamp(toneMapping ? toneMapping(pixels[i]) : pixels[i], 0.0f, 1.0f);
+        out[3 * i] = (unsigned char) color.r;
+        out[3 * i + 1] = (unsigned char) color.g;
+        out[3 * i + 2] = (unsigned char) color.b;
+    }
+}
+
+std::unique_ptr<ImageWriter> ImageWriter::create(const std::string &path, const ToneMapping toneMapping)
+{
+    const size_t dot = path.find_last_of('.');
+    const std::string extension = dot == std::string::npos ? "" : path.substr(dot + 1);
+    std::unique_ptr<ImageWriter> writer = createForFormat(extension, toneMapping);
+    if (writer)
+        return writer;
+    std::cerr << "Unknown image format for " << path << ", writing PNG" << std::endl;
+    return std::make_unique<PNGWriter>(toneMapping);
+}
+
+std::unique_ptr<ImageWriter> ImageWriter::createForFormat(const std::string &format, const ToneMapping toneMapping)
+{
+    if (format == "pfm")
+        return std::make_unique<PFMWriter>();
+    if (format == "ppm")
+        return std::make_unique<PPMWriter>(toneMapping);
+    if (format == "png")
+        return std::make_unique<PNGWriter>(toneMapping);
+    return nullptr;
+}